@@ -296,6 +296,14 @@ int8_t block_get_aaprofile(const struct AAProfile *profile, uintptr_t i, uint8_t
  */
 int8_t block_get_gap_extend_aaprofile(const struct AAProfile *profile);
 
+/**
+ * Start aligning at a certain position of the profile.
+ *
+ * The profile then behaves like its suffix from that position on, until it is cleared.
+ * This allows loading a profile once and aligning from different positions.
+ */
+void block_set_offset_aaprofile(struct AAProfile *profile, uintptr_t offset);
+
 /**
  * Frees an AAProfile.
  */
@@ -342,6 +350,14 @@ void block_set_bytes_rev_padded_aa(struct PaddedBytes *padded,
                                    uintptr_t len,
                                    uintptr_t max_size);
 
+/**
+ * Start aligning at a certain index of a padded amino acid string.
+ *
+ * The string then behaves like its suffix from that index on, until it is written again.
+ * This allows loading a string once and aligning from different positions.
+ */
+void block_set_offset_padded_aa(struct PaddedBytes *padded, uintptr_t offset);
+
 /**
  * Frees a padded amino acid string.
  */
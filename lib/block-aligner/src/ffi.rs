@@ -188,6 +188,16 @@ pub unsafe extern fn block_get_gap_extend_aaprofile(profile: *const AAProfile) -
     profile.get_gap_extend()
 }
 
+/// Start aligning at a certain position of the profile.
+///
+/// The profile then behaves like its suffix from that position on, until it is cleared.
+/// This allows loading a profile once and aligning from different positions.
+#[no_mangle]
+pub unsafe extern fn block_set_offset_aaprofile(profile: *mut AAProfile, offset: usize) {
+    let profile = &mut *profile;
+    profile.set_offset(offset);
+}
+
 /// Frees an AAProfile.
 #[no_mangle]
 pub unsafe extern fn block_free_aaprofile(profile: *mut AAProfile) {
@@ -250,6 +260,16 @@ pub unsafe extern fn block_set_bytes_rev_padded_aa(padded: *mut PaddedBytes, s:
     padded_bytes.set_bytes_rev::<AAMatrix>(bytes, max_size);
 }
 
+/// Start aligning at a certain index of a padded amino acid string.
+///
+/// The string then behaves like its suffix from that index on, until it is written again.
+/// This allows loading a string once and aligning from different positions.
+#[no_mangle]
+pub unsafe extern fn block_set_offset_padded_aa(padded: *mut PaddedBytes, offset: usize) {
+    let padded_bytes = &mut *padded;
+    padded_bytes.set_offset(offset);
+}
+
 /// Frees a padded amino acid string.
 #[no_mangle]
 pub unsafe extern fn block_free_padded_aa(padded: *mut PaddedBytes) {
@@ -1783,10 +1783,14 @@ impl Drop for Aligned {
 ///
 /// A single padding byte in inserted before the start of the string,
 /// and `block_size` bytes are inserted after the end of the string.
+///
+/// With a start offset, the string is aligned as if it started at that offset, so a
+/// string can be loaded once and aligned from different positions.
 #[derive(Clone, PartialEq, Debug)]
 pub struct PaddedBytes {
     s: Vec<u8>,
-    len: usize
+    len: usize,
+    offset: usize
 }
 
 impl PaddedBytes {
@@ -1795,7 +1799,8 @@ impl PaddedBytes {
     pub fn new<M: Matrix>(len: usize, block_size: usize) -> Self {
         Self {
             s: vec![M::convert_char(M::NULL); 1 + len + block_size],
-            len
+            len,
+            offset: 0
         }
     }
 
@@ -1806,6 +1811,7 @@ impl PaddedBytes {
         self.s[1..1 + b.len()].iter_mut().for_each(|c| *c = M::convert_char(*c));
         self.s[1 + b.len()..1 + b.len() + block_size].fill(M::convert_char(M::NULL));
         self.len = b.len();
+        self.offset = 0;
     }
 
     /// Modifies the bytes in place in reverse, filling in the rest of the memory with padding bytes.
@@ -1816,6 +1822,7 @@ impl PaddedBytes {
         self.s[1..1 + b.len()].iter_mut().for_each(|c| *c = M::convert_char(*c));
         self.s[1 + b.len()..1 + b.len() + block_size].fill(M::convert_char(M::NULL));
         self.len = b.len();
+        self.offset = 0;
     }
 
     /// Create from a byte slice.
@@ -1829,7 +1836,7 @@ impl PaddedBytes {
         v.insert(0, M::NULL);
         v.resize(v.len() + block_size, M::NULL);
         v.iter_mut().for_each(|c| *c = M::convert_char(*c));
-        Self { s: v, len }
+        Self { s: v, len, offset: 0 }
     }
 
     /// Create from the bytes in a string slice.
@@ -1852,31 +1859,40 @@ impl PaddedBytes {
         v.insert(0, M::NULL);
         v.resize(v.len() + block_size, M::NULL);
         v.iter_mut().for_each(|c| *c = M::convert_char(*c));
-        Self { s: v, len }
+        Self { s: v, len, offset: 0 }
+    }
+
+    /// Start aligning at a certain index of the original string.
+    ///
+    /// The string then behaves like its suffix from that index on, until the bytes are set again.
+    #[inline]
+    pub fn set_offset(&mut self, offset: usize) {
+        assert!(offset <= self.len);
+        self.offset = offset;
     }
 
     /// Get the byte at a certain index (unchecked).
     #[inline]
     pub unsafe fn get(&self, i: usize) -> u8 {
-        *self.s.as_ptr().add(i)
+        *self.s.as_ptr().add(self.offset + i)
     }
 
     /// Set the byte at a certain index (unchecked).
     #[inline]
     pub unsafe fn set(&mut self, i: usize, c: u8) {
-        *self.s.as_mut_ptr().add(i) = c;
+        *self.s.as_mut_ptr().add(self.offset + i) = c;
     }
 
     /// Create a pointer to a specific index.
     #[inline]
     pub unsafe fn as_ptr(&self, i: usize) -> *const u8 {
-        self.s.as_ptr().add(i)
+        self.s.as_ptr().add(self.offset + i)
     }
 
-    /// Length of the original string (no padding).
+    /// Length of the original string (no padding), after the start offset.
     #[inline]
     pub fn len(&self) -> usize {
-        self.len
+        self.len - self.offset
     }
 }
 
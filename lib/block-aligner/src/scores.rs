@@ -462,7 +462,9 @@ pub struct AAProfile {
     curr_len: usize,
     // length of the profile without padding (same length as the consensus sequence of the position
     // specific scoring matrix)
-    str_len: usize
+    str_len: usize,
+    // position that alignments start at, the profile behaves like its suffix from there on
+    offset: usize
 }
 
 impl Profile for AAProfile {
@@ -479,7 +481,8 @@ impl Profile for AAProfile {
             pos_gap_open_R: vec![i8::MIN as i16; max_len],
             max_len,
             curr_len: max_len,
-            str_len
+            str_len,
+            offset: 0
         }
     }
 
@@ -503,7 +506,7 @@ impl Profile for AAProfile {
     }
 
     fn len(&self) -> usize {
-        self.str_len
+        self.str_len - self.offset
     }
 
     fn clear(&mut self, str_len: usize, block_size: usize) {
@@ -516,6 +519,7 @@ impl Profile for AAProfile {
         self.pos_gap_open_R[..curr_len].fill(i8::MIN as i16);
         self.str_len = str_len;
         self.curr_len = curr_len;
+        self.offset = 0;
     }
 
     fn set(&mut self, i: usize, b: u8, score: i8) {
@@ -576,14 +580,14 @@ impl Profile for AAProfile {
 
     #[inline]
     fn as_ptr_pos(&self, i: usize) -> *const i8 {
-        debug_assert!(i < self.curr_len);
-        unsafe { self.pos_aa.as_ptr().add(i * 32) }
+        debug_assert!(self.offset + i < self.curr_len);
+        unsafe { self.pos_aa.as_ptr().add((self.offset + i) * 32) }
     }
 
     #[inline]
     fn as_ptr_aa(&self, a: usize) -> *const i16 {
         debug_assert!(a < 27);
-        unsafe { self.aa_pos.as_ptr().add(a * self.curr_len) }
+        unsafe { self.aa_pos.as_ptr().add(a * self.curr_len + self.offset) }
     }
 
     #[cfg_attr(feature = "simd_sse2", target_feature(enable = "sse2"))]
@@ -615,7 +619,7 @@ impl Profile for AAProfile {
     #[cfg_attr(feature = "simd_neon", target_feature(enable = "neon"))]
     #[inline]
     unsafe fn get_gap_open_right_C(&self, i: usize) -> Simd {
-        simd_set1_i16(*self.pos_gap_open_C.as_ptr().add(i))
+        simd_set1_i16(*self.pos_gap_open_C.as_ptr().add(self.offset + i))
     }
 
     #[cfg_attr(feature = "simd_sse2", target_feature(enable = "sse2"))]
@@ -624,7 +628,7 @@ impl Profile for AAProfile {
     #[cfg_attr(feature = "simd_neon", target_feature(enable = "neon"))]
     #[inline]
     unsafe fn get_gap_close_right_C(&self, i: usize) -> Simd {
-        simd_set1_i16(*self.pos_gap_close_C.as_ptr().add(i))
+        simd_set1_i16(*self.pos_gap_close_C.as_ptr().add(self.offset + i))
     }
 
     #[cfg_attr(feature = "simd_sse2", target_feature(enable = "sse2"))]
@@ -633,7 +637,7 @@ impl Profile for AAProfile {
     #[cfg_attr(feature = "simd_neon", target_feature(enable = "neon"))]
     #[inline]
     unsafe fn get_gap_open_right_R(&self, i: usize) -> Simd {
-        simd_set1_i16(*self.pos_gap_open_R.as_ptr().add(i))
+        simd_set1_i16(*self.pos_gap_open_R.as_ptr().add(self.offset + i))
     }
 
     #[cfg_attr(feature = "simd_sse2", target_feature(enable = "sse2"))]
@@ -642,7 +646,7 @@ impl Profile for AAProfile {
     #[cfg_attr(feature = "simd_neon", target_feature(enable = "neon"))]
     #[inline]
     unsafe fn get_gap_open_down_C(&self, i: usize) -> Simd {
-        simd_loadu(self.pos_gap_open_C.as_ptr().add(i) as *const Simd)
+        simd_loadu(self.pos_gap_open_C.as_ptr().add(self.offset + i) as *const Simd)
     }
 
     #[cfg_attr(feature = "simd_sse2", target_feature(enable = "sse2"))]
@@ -651,7 +655,7 @@ impl Profile for AAProfile {
     #[cfg_attr(feature = "simd_neon", target_feature(enable = "neon"))]
     #[inline]
     unsafe fn get_gap_close_down_C(&self, i: usize) -> Simd {
-        simd_loadu(self.pos_gap_close_C.as_ptr().add(i) as *const Simd)
+        simd_loadu(self.pos_gap_close_C.as_ptr().add(self.offset + i) as *const Simd)
     }
 
     #[cfg_attr(feature = "simd_sse2", target_feature(enable = "sse2"))]
@@ -660,7 +664,7 @@ impl Profile for AAProfile {
     #[cfg_attr(feature = "simd_neon", target_feature(enable = "neon"))]
     #[inline]
     unsafe fn get_gap_open_down_R(&self, i: usize) -> Simd {
-        simd_loadu(self.pos_gap_open_R.as_ptr().add(i) as *const Simd)
+        simd_loadu(self.pos_gap_open_R.as_ptr().add(self.offset + i) as *const Simd)
     }
 
     #[inline]
@@ -672,6 +676,15 @@ impl Profile for AAProfile {
 }
 
 impl AAProfile {
+    /// Start aligning at a certain position of the profile.
+    ///
+    /// The profile then behaves like its suffix from that position on, until it is cleared.
+    /// Scores and gap costs are still set and read at the positions of the whole profile.
+    pub fn set_offset(&mut self, offset: usize) {
+        assert!(offset <= self.str_len);
+        self.offset = offset;
+    }
+
     fn set_all_core<const REV: bool>(&mut self, order: &[u8], scores: &[i8], left_shift: usize, right_shift: usize) {
         #[repr(align(32))]
         struct A([u8; 32]);
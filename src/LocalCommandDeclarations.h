@@ -4,6 +4,7 @@
 #include "Command.h"
 
 extern int createkmertable(int argc, const char **argv, const Command& command);
+extern int mergekmertables(int argc, const char **argv, const Command& command);
 extern int comparekmertables(int argc, const char **argv, const Command& command);
 extern int blockalign(int argc, const char **argv, const Command& command);
 extern int convert2sradb(int argc, const char **argv, const Command& command);
@@ -11,6 +12,9 @@ extern int petasearch(int argc, const char **argv, const Command& command);
 extern int easypetasearch(int argc, const char **argv, const Command &command);
 extern int convertsraalignments(int argc, const char **argv, const Command &command);
 extern int readandprint(int argc, const char **argv, const Command &command);
+extern int benchmarkkmergen(int argc, const char **argv, const Command &command);
+extern int benchmarkkmerindex(int argc, const char **argv, const Command &command);
+extern int benchmarkalignbackends(int argc, const char **argv, const Command &command);
 extern int playground(int argc, const char **argv, const Command &command);
 
 #endif
@@ -0,0 +1,124 @@
+#include "BatchUngappedAligner.h"
+#include "Parameters.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <climits>
+
+#define BATCH_LANES (VECSIZE_INT * 2)
+
+size_t BatchUngappedAligner::add(const char *querySeq, unsigned int querySeqLen,
+                                 const char *targetSeq, unsigned int targetSeqLen, unsigned int diagonal) {
+    const size_t index = alignments.size();
+    alignments.emplace_back();
+    if (rescoreMode != Parameters::RESCORE_MODE_ALIGNMENT || querySeqLen >= 32768 || targetSeqLen >= 32768) {
+        // the diagonal wraps around at 2^16, leave the long sequences to DistanceCalculator
+        alignments[index] = DistanceCalculator::computeUngappedAlignment(
+            querySeq, querySeqLen, targetSeq, targetSeqLen, (unsigned short) diagonal, matrix, rescoreMode
+        );
+        return index;
+    }
+    // both sequences are shorter than 2^15, so the 16-bit diagonal has only one candidate
+    const int realDiagonal = (short) (unsigned short) diagonal;
+    const unsigned int distToDiagonal = (unsigned int) std::abs(realDiagonal);
+    Lane lane;
+    lane.diagonal = realDiagonal;
+    lane.index = index;
+    if (realDiagonal >= 0 && distToDiagonal < querySeqLen) {
+        lane.seq1 = querySeq + distToDiagonal;
+        lane.seq2 = targetSeq;
+        lane.length = std::min(targetSeqLen, querySeqLen - distToDiagonal);
+    } else if (realDiagonal < 0 && distToDiagonal < targetSeqLen) {
+        lane.seq1 = querySeq;
+        lane.seq2 = targetSeq + distToDiagonal;
+        lane.length = std::min(targetSeqLen - distToDiagonal, querySeqLen);
+    } else {
+        return index;
+    }
+    if (lane.length > 0) {
+        lanes.emplace_back(lane);
+    }
+    return index;
+}
+
+void BatchUngappedAligner::setResult(const Lane &lane, int score, int startPos, int endPos) {
+    // computeUngappedAlignment only keeps alignments with a positive score
+    if (score <= 0) {
+        return;
+    }
+    DistanceCalculator::LocalAlignment &alignment = alignments[lane.index];
+    alignment.startPos = startPos;
+    alignment.endPos = endPos;
+    alignment.score = score;
+    alignment.diagonalLen = lane.length;
+    alignment.distToDiagonal = (unsigned int) std::abs(lane.diagonal);
+    alignment.diagonal = lane.diagonal;
+}
+
+void BatchUngappedAligner::align() {
+    std::sort(lanes.begin(), lanes.end(), [](const Lane &first, const Lane &second) {
+        return first.length > second.length;
+    });
+    for (size_t start = 0; start < lanes.size(); start += BATCH_LANES) {
+        alignGroup(lanes.data() + start, std::min((size_t) BATCH_LANES, lanes.size() - start));
+    }
+}
+
+// same recurrence as DistanceCalculator::computeSubstitutionStartEndDistance, one diagonal per lane
+void BatchUngappedAligner::alignGroup(const Lane *group, size_t count) {
+    short scores[BATCH_LANES] __attribute__((aligned(ALIGN_INT)));
+    short best[BATCH_LANES] __attribute__((aligned(ALIGN_INT)));
+    short bestStart[BATCH_LANES] __attribute__((aligned(ALIGN_INT)));
+    short bestEnd[BATCH_LANES] __attribute__((aligned(ALIGN_INT)));
+
+    const simd_int zero = simdi_setzero();
+    const simd_int one = simdi16_set(1);
+    simd_int vCurrent = zero;
+    simd_int vBest = zero;
+    simd_int vBestStart = zero;
+    simd_int vBestEnd = zero;
+    simd_int vMinPos = simdi16_set(-1);
+
+    // lanes are sorted by length, past its end a lane gets a score that never yields a new maximum
+    const unsigned int maxLength = group[0].length;
+    const unsigned int minLength = group[count - 1].length;
+    std::fill(scores, scores + BATCH_LANES, (short) SHRT_MIN);
+    for (unsigned int pos = 0; pos < maxLength; ++pos) {
+        if (pos < minLength) {
+            for (size_t l = 0; l < count; ++l) {
+                scores[l] = matrix[static_cast<int>(group[l].seq1[pos])][static_cast<int>(group[l].seq2[pos])];
+            }
+        } else {
+            for (size_t l = 0; l < count; ++l) {
+                scores[l] = pos < group[l].length
+                            ? matrix[static_cast<int>(group[l].seq1[pos])][static_cast<int>(group[l].seq2[pos])]
+                            : (short) SHRT_MIN;
+            }
+        }
+        const simd_int vPos = simdi16_set((short) pos);
+        const simd_int vScore = simdi16_adds(vCurrent, simdi_load((simd_int *) scores));
+        const simd_int isPositive = simdi16_gt(vScore, zero);
+        vCurrent = simdi16_max(vScore, zero);
+        vMinPos = simdi8_blend(vPos, vMinPos, isPositive);
+        const simd_int isNewMax = simdi16_gt(vCurrent, vBest);
+        vBestEnd = simdi8_blend(vBestEnd, vPos, isNewMax);
+        vBestStart = simdi8_blend(vBestStart, simdi16_add(vMinPos, one), isNewMax);
+        vBest = simdi16_max(vBest, vCurrent);
+    }
+    simdi_store((simd_int *) best, vBest);
+    simdi_store((simd_int *) bestStart, vBestStart);
+    simdi_store((simd_int *) bestEnd, vBestEnd);
+
+    for (size_t l = 0; l < count; ++l) {
+        const Lane &lane = group[l];
+        if (best[l] == SHRT_MAX) {
+            // saturated, the 16-bit score is not exact anymore
+            DistanceCalculator::LocalAlignment tmp = DistanceCalculator::computeSubstitutionStartEndDistance(
+                lane.seq1, lane.seq2, lane.length, matrix
+            );
+            setResult(lane, (int) tmp.score, tmp.startPos, tmp.endPos);
+        } else {
+            setResult(lane, best[l], bestStart[l], bestEnd[l]);
+        }
+    }
+}
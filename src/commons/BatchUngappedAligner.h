@@ -0,0 +1,55 @@
+#ifndef SRASEARCH_BATCHUNGAPPEDALIGNER_H
+#define SRASEARCH_BATCHUNGAPPEDALIGNER_H
+
+#include "DistanceCalculator.h"
+
+#include <vector>
+
+/**
+ * @brief Ungapped alignment of many (query, target, diagonal) triples at once, one triple per 16-bit SIMD lane
+ * Gives the same alignments as DistanceCalculator::computeUngappedAlignment with RESCORE_MODE_ALIGNMENT.
+ * Triples are grouped by diagonal length to keep the lanes busy. Other rescore modes, sequences of 32768
+ * residues or more and lanes whose score saturates are computed with DistanceCalculator instead.
+ */
+class BatchUngappedAligner {
+public:
+    BatchUngappedAligner(const char **matrix, int rescoreMode) : matrix(matrix), rescoreMode(rescoreMode) {}
+
+    // diagonal is the query position minus the target position, sequences have to stay valid until align()
+    size_t add(const char *querySeq, unsigned int querySeqLen, const char *targetSeq, unsigned int targetSeqLen,
+               unsigned int diagonal);
+
+    void align();
+
+    const DistanceCalculator::LocalAlignment &getAlignment(size_t i) const {
+        return alignments[i];
+    }
+
+    size_t size() const {
+        return alignments.size();
+    }
+
+    void clear() {
+        lanes.clear();
+        alignments.clear();
+    }
+
+private:
+    struct Lane {
+        const char *seq1;
+        const char *seq2;
+        unsigned int length;
+        int diagonal;
+        size_t index;
+    };
+
+    const char **matrix;
+    const int rescoreMode;
+    std::vector<Lane> lanes;
+    std::vector<DistanceCalculator::LocalAlignment> alignments;
+
+    void alignGroup(const Lane *group, size_t count);
+    void setResult(const Lane &lane, int score, int startPos, int endPos);
+};
+
+#endif
@@ -6,6 +6,8 @@
 #include "EvalueComputation.h"
 #include "DistanceCalculator.h"
 
+#include <cfloat>
+
 BlockAligner::BlockAligner(
     size_t maxSequenceLength,
     uintptr_t min,
@@ -13,15 +15,22 @@ BlockAligner::BlockAligner(
     int8_t gapOpen,
     int8_t gapExtend,
     BaseMatrix& subMat,
-    int dbtype
-) : range({min, max}),
+    int dbtype,
+    bool adaptiveRange
+) : aKey(NO_KEY),
+    aSeq(NULL),
+    aLen(0),
+    aLoaded(false),
+    range({min, max}),
+    alignRange({min, max}),
+    adaptiveRange(adaptiveRange),
     gaps({gapOpen, gapExtend}),
     subMat(subMat),
     dbtype(dbtype),
     fastMatrix(SubstitutionMatrix::createAsciiSubMat(subMat)) {
     a = block_new_padded_aa(maxSequenceLength, max);
+    aRev = block_new_padded_aa(maxSequenceLength, max);
     if (Parameters::isEqualDbtype(dbtype, Parameters::DBTYPE_HMM_PROFILE) == false) {
-        b = block_new_padded_aa(maxSequenceLength, max);
         matrix = block_new_simple_aamatrix(1, -1);
         for (int i = 0; i < subMat.alphabetSize; i++) {
             for (int j = 0; j < subMat.alphabetSize; j++) {
@@ -34,7 +43,8 @@ BlockAligner::BlockAligner(
             }
         }
     } else {
-        bProfile = block_new_aaprofile(maxSequenceLength, max, gaps.extend);
+        memset(profileOrder, 'U', Sequence::PROFILE_READIN_SIZE);
+        memcpy(profileOrder, (uint8_t*)subMat.num2aa, Sequence::PROFILE_AA_SIZE);
     }
     blockTrace = block_new_aa_trace_xdrop(maxSequenceLength, maxSequenceLength, max);
     blockNoTrace = block_new_aa_xdrop(maxSequenceLength, maxSequenceLength, max);
@@ -47,96 +57,169 @@ BlockAligner::~BlockAligner() {
     block_free_aa_trace_xdrop(blockTrace);
     block_free_aa_xdrop(blockNoTrace);
     block_free_padded_aa(a);
+    block_free_padded_aa(aRev);
     if (Parameters::isEqualDbtype(dbtype, Parameters::DBTYPE_HMM_PROFILE) == false) {
-        block_free_padded_aa(b);
         block_free_aamatrix(matrix);
-    } else {
-        block_free_aaprofile(bProfile);
     }
     delete[] sAlnCigar;
 }
 
+BlockAligner::Target::~Target() {
+    if (forward != NULL) {
+        block_free_padded_aa(forward);
+        block_free_padded_aa(reverse);
+    }
+    if (forwardProfile != NULL) {
+        block_free_aaprofile(forwardProfile);
+        block_free_aaprofile(reverseProfile);
+    }
+}
+
+void BlockAligner::setQuery(unsigned int queryKey, const char* querySeq, unsigned int queryLength) {
+    if (queryKey != NO_KEY && queryKey == aKey && aLoaded) {
+        return;
+    }
+    aKey = queryKey;
+    aSeq = querySeq;
+    aLen = queryLength;
+    aLoaded = false;
+}
+
+void BlockAligner::loadQuery() {
+    block_set_bytes_padded_aa(a, (uint8_t*)aSeq, aLen, range.max);
+    block_set_bytes_rev_padded_aa(aRev, (uint8_t*)aSeq, aLen, range.max);
+    aLoaded = true;
+}
+
+void BlockAligner::loadTarget(Target& target, unsigned int targetKey, const char* targetSeq, unsigned int targetLength) {
+    if (Parameters::isEqualDbtype(dbtype, Parameters::DBTYPE_HMM_PROFILE) == false) {
+        if (target.forward == NULL || targetLength > target.capacity) {
+            if (target.forward != NULL) {
+                block_free_padded_aa(target.forward);
+                block_free_padded_aa(target.reverse);
+            }
+            target.forward = block_new_padded_aa(targetLength, range.max);
+            target.reverse = block_new_padded_aa(targetLength, range.max);
+            target.capacity = targetLength;
+        }
+        block_set_bytes_padded_aa(target.forward, (uint8_t*)targetSeq, targetLength, range.max);
+        block_set_bytes_rev_padded_aa(target.reverse, (uint8_t*)targetSeq, targetLength, range.max);
+    } else {
+        if (target.forwardProfile == NULL || targetLength > target.capacity) {
+            if (target.forwardProfile != NULL) {
+                block_free_aaprofile(target.forwardProfile);
+                block_free_aaprofile(target.reverseProfile);
+            }
+            target.forwardProfile = block_new_aaprofile(targetLength, range.max, gaps.extend);
+            target.reverseProfile = block_new_aaprofile(targetLength, range.max, gaps.extend);
+            target.capacity = targetLength;
+        }
+        const int aa = Sequence::PROFILE_READIN_SIZE;
+        for (int reverse = 0; reverse < 2; ++reverse) {
+            AAProfile* profile = reverse ? target.reverseProfile : target.forwardProfile;
+            block_clear_aaprofile(profile, targetLength, range.max);
+            // note: scores are divided by 4 by shifting right by 2
+            if (reverse) {
+                block_set_all_rev_aaprofile(profile, profileOrder, aa, (int8_t*)targetSeq, targetLength * aa, 0, 2);
+            } else {
+                block_set_all_aaprofile(profile, profileOrder, aa, (int8_t*)targetSeq, targetLength * aa, 0, 2);
+            }
+            block_set_all_gap_open_C_aaprofile(profile, gaps.open);
+            block_set_all_gap_close_C_aaprofile(profile, 0);
+            block_set_all_gap_open_R_aaprofile(profile, gaps.open);
+        }
+    }
+    target.key = targetKey;
+    target.length = targetLength;
+}
+
+// block-aligner grows the block up to this size when the alignment leaves it, long indels need large blocks.
+// An indel can at most span the residues not covered by the ungapped seed, the cap is half of them
+// so pairs that are mostly explained by their seed stay at the small block size.
+uintptr_t BlockAligner::adaptiveMaxSize(size_t queryLength, size_t targetLength, const LocalAln& seed) const {
+    const size_t seedLength = seed.a_end >= seed.a_start ? seed.a_end - seed.a_start + 1 : 0;
+    const size_t longest = std::max(queryLength, targetLength);
+    const size_t uncovered = longest > seedLength ? longest - seedLength : 0;
+    uintptr_t size = range.min;
+    while (size < range.max && size * 2 < uncovered) {
+        size *= 2;
+    }
+    return size;
+}
+
 // note: traceback cigar string will be reversed, but LocalAln will contain correct start and end positions
-BlockAligner::LocalAln align_local(
-    BlockHandle block_trace, BlockHandle block_no_trace,
-    const char* a_str, size_t a_len, PaddedBytes* a,
-    const char* b_str, size_t b_len, PaddedBytes* b,
-    const AAMatrix* matrix, Gaps gaps,
-    int a_idx, int b_idx,
-    Cigar* cigar, SizeRange range, int32_t x_drop
+// the traceback is skipped (and the cigar left untouched) if the E-value of the score-only reverse pass is above evalThr
+bool BlockAligner::alignLocal(
+    Target& target,
+    size_t a_idx, size_t b_idx, int32_t seed_score, int32_t x_drop,
+    EvalueComputation *evaluer, double evalThr,
+    BlockAligner::LocalAln& res_aln
 ) {
-    BlockAligner::LocalAln res_aln;
     AlignResult res;
 
     // forwards alignment starting at (a_idx, b_idx)
-    block_set_bytes_padded_aa(a, (uint8_t*)(a_str + a_idx), a_len - a_idx, range.max);
-    block_set_bytes_padded_aa(b, (uint8_t*)(b_str + b_idx), b_len - b_idx, range.max);
+    block_set_offset_padded_aa(a, a_idx);
+    block_set_offset_padded_aa(target.forward, b_idx);
 
-    block_align_aa_xdrop(block_no_trace, a, b, matrix, gaps, range, x_drop);
-    res = block_res_aa_xdrop(block_no_trace);
+    block_align_aa_xdrop(blockNoTrace, a, target.forward, matrix, gaps, alignRange, x_drop);
+    res = block_res_aa_xdrop(blockNoTrace);
 
     res_aln.a_end = a_idx + res.query_idx;
     res_aln.b_end = b_idx + res.reference_idx;
 
-    // reversed alignment starting at the max score location from forwards alignment
-    block_set_bytes_rev_padded_aa(a, (uint8_t*)a_str, res_aln.a_end, range.max);
-    block_set_bytes_rev_padded_aa(b, (uint8_t*)b_str, res_aln.b_end, range.max);
+    // reversed alignment starting at the max score location from forwards alignment,
+    // the reverse buffers hold the whole sequences so the prefixes up to it start at these offsets
+    block_set_offset_padded_aa(aRev, aLen - res_aln.a_end);
+    block_set_offset_padded_aa(target.reverse, target.length - res_aln.b_end);
+
+    // the reverse pass can follow the forward path back into the ungapped seed ending at (a_idx, b_idx),
+    // the score-only pass is only worth it if this path does not already pass evalThr
+    if (evaluer->computeEvalue(seed_score + res.score, aLen) > evalThr) {
+        // the score-only pass computes the same score as the traceback pass
+        block_align_aa_xdrop(blockNoTrace, aRev, target.reverse, matrix, gaps, alignRange, x_drop);
+        res = block_res_aa_xdrop(blockNoTrace);
+        res_aln.a_start = res_aln.a_end - res.query_idx;
+        res_aln.b_start = res_aln.b_end - res.reference_idx;
+        res_aln.score = res.score;
+        if (evaluer->computeEvalue(res.score, aLen) > evalThr) {
+            return false;
+        }
+    }
 
-    block_align_aa_trace_xdrop(block_trace, a, b, matrix, gaps, range, x_drop);
-    res = block_res_aa_trace_xdrop(block_trace);
-    block_cigar_eq_aa_trace_xdrop(block_trace, a, b, res.query_idx, res.reference_idx, cigar);
+    block_align_aa_trace_xdrop(blockTrace, aRev, target.reverse, matrix, gaps, alignRange, x_drop);
+    res = block_res_aa_trace_xdrop(blockTrace);
+    block_cigar_eq_aa_trace_xdrop(blockTrace, aRev, target.reverse, res.query_idx, res.reference_idx, cigar);
 
     res_aln.a_start = res_aln.a_end - res.query_idx;
     res_aln.b_start = res_aln.b_end - res.reference_idx;
     res_aln.score = res.score;
-    return res_aln;
+    return true;
 }
 
-BlockAligner::LocalAln align_local_profile(
-    BlockHandle block_trace, BlockHandle block_no_trace,
-    const char* a_str, const size_t a_len, PaddedBytes* a,
-    const char* b_str, const size_t b_len, AAProfile* bProfile,
-    Gaps gaps, BaseMatrix& subMat,
-    int a_idx, int b_idx,
-    Cigar* cigar, SizeRange range, int32_t x_drop
+BlockAligner::LocalAln BlockAligner::alignLocalProfile(
+    Target& target,
+    size_t a_idx, size_t b_idx, int32_t x_drop
 ) {
     BlockAligner::LocalAln res_aln;
     AlignResult res;
 
     // forwards alignment starting at (a_idx, b_idx)
-    block_set_bytes_padded_aa(a, (uint8_t*)(a_str + a_idx), a_len - a_idx, range.max);
-
-    // assign extra profile columns to 'U', which is unused
-    int aa = Sequence::PROFILE_READIN_SIZE;
-    uint8_t order[Sequence::PROFILE_READIN_SIZE];
-    memset(order, 'U', Sequence::PROFILE_READIN_SIZE);
-    memcpy(order, (uint8_t*)subMat.num2aa, Sequence::PROFILE_AA_SIZE);
+    block_set_offset_padded_aa(a, a_idx);
+    block_set_offset_aaprofile(target.forwardProfile, b_idx);
 
-    block_clear_aaprofile(bProfile, b_len - b_idx, range.max);
-    // note: scores are divided by 4 by shifting right by 2
-    block_set_all_aaprofile(bProfile, order, aa, (int8_t*)(b_str + b_idx * aa), (b_len - b_idx) * aa, 0, 2);
-    block_set_all_gap_open_C_aaprofile(bProfile, gaps.open);
-    block_set_all_gap_close_C_aaprofile(bProfile, 0);
-    block_set_all_gap_open_R_aaprofile(bProfile, gaps.open);
-
-    block_align_profile_aa_xdrop(block_no_trace, a, bProfile, range, x_drop);
-    res = block_res_aa_xdrop(block_no_trace);
+    block_align_profile_aa_xdrop(blockNoTrace, a, target.forwardProfile, alignRange, x_drop);
+    res = block_res_aa_xdrop(blockNoTrace);
 
     res_aln.a_end = a_idx + res.query_idx;
     res_aln.b_end = b_idx + res.reference_idx;
 
     // reversed alignment starting at the max score location from forwards alignment
-    block_set_bytes_rev_padded_aa(a, (uint8_t*)a_str, res_aln.a_end, range.max);
-
-    block_clear_aaprofile(bProfile, res_aln.b_end, range.max);
-    block_set_all_rev_aaprofile(bProfile, order, aa, (int8_t*)b_str, res_aln.b_end * aa, 0, 2);
-    block_set_all_gap_open_C_aaprofile(bProfile, gaps.open);
-    block_set_all_gap_close_C_aaprofile(bProfile, 0);
-    block_set_all_gap_open_R_aaprofile(bProfile, gaps.open);
+    block_set_offset_padded_aa(aRev, aLen - res_aln.a_end);
+    block_set_offset_aaprofile(target.reverseProfile, target.length - res_aln.b_end);
 
-    block_align_profile_aa_trace_xdrop(block_trace, a, bProfile, range, x_drop);
-    res = block_res_aa_trace_xdrop(block_trace);
-    block_cigar_aa_trace_xdrop(block_trace, res.query_idx, res.reference_idx, cigar);
+    block_align_profile_aa_trace_xdrop(blockTrace, aRev, target.reverseProfile, alignRange, x_drop);
+    res = block_res_aa_trace_xdrop(blockTrace);
+    block_cigar_aa_trace_xdrop(blockTrace, res.query_idx, res.reference_idx, cigar);
 
     res_aln.a_start = res_aln.a_end - res.query_idx;
     res_aln.b_start = res_aln.b_end - res.reference_idx;
@@ -155,9 +238,12 @@ BlockAligner::LocalAln BlockAligner::ungappedAlign(
         targetCon != NULL ? targetCon : targetSeq, targetLen,
         diagonal, fastMatrix.matrix, Parameters::RESCORE_MODE_ALIGNMENT
     );
+    return fromUngapped(alignment);
+}
 
+BlockAligner::LocalAln BlockAligner::fromUngapped(const DistanceCalculator::LocalAlignment &alignment) {
     unsigned int distanceToDiagonal = alignment.distToDiagonal;
-    diagonal = alignment.diagonal;
+    int diagonal = alignment.diagonal;
 
     int qUngappedStartPos, qUngappedEndPos, dbUngappedStartPos, dbUngappedEndPos;
     if (diagonal >= 0) {
@@ -240,12 +326,68 @@ BlockAligner::align(
         targetSeq, targetCon, targetLength,
         diagonal
     );
+    return align(querySeq, queryLength, targetSeq, targetLength, pos, backtrace, evaluer, xdrop, DBL_MAX);
+}
+
+s_align
+BlockAligner::align(
+    const char* querySeq,
+    unsigned int queryLength,
+    const char* targetSeq,
+    unsigned int targetLength,
+    const LocalAln& seed,
+    std::string& backtrace,
+    EvalueComputation *evaluer,
+    int xdrop,
+    double evalThr
+) {
+    setQuery(NO_KEY, querySeq, queryLength);
+    return alignTarget(NO_KEY, targetSeq, targetLength, seed, backtrace, evaluer, xdrop, evalThr);
+}
 
+s_align
+BlockAligner::alignTarget(
+    unsigned int targetKey,
+    const char* targetSeq,
+    unsigned int targetLength,
+    const LocalAln& seed,
+    std::string& backtrace,
+    EvalueComputation *evaluer,
+    int xdrop,
+    double evalThr
+) {
+    if (targetKey == NO_KEY || targetKey != keyedTarget.getKey()) {
+        loadTarget(keyedTarget, targetKey, targetSeq, targetLength);
+    }
+    return alignTarget(keyedTarget, seed, backtrace, evaluer, xdrop, evalThr);
+}
+
+s_align
+BlockAligner::alignTarget(
+    Target& target,
+    const LocalAln& seed,
+    std::string& backtrace,
+    EvalueComputation *evaluer,
+    int xdrop,
+    double evalThr
+) {
+    if (aLoaded == false) {
+        loadQuery();
+    }
+    const unsigned int queryLength = aLen;
+    const unsigned int targetLength = target.length;
+    alignRange = range;
+    if (adaptiveRange) {
+        alignRange.max = adaptiveMaxSize(queryLength, targetLength, seed);
+    }
     LocalAln local_aln;
+    bool traced;
     if (Parameters::isEqualDbtype(dbtype, Parameters::DBTYPE_HMM_PROFILE) == false) {
-        local_aln = align_local(blockTrace, blockNoTrace, querySeq, queryLength, a, targetSeq, targetLength, b, matrix, gaps, pos.a_end, pos.b_end, cigar, range, xdrop);
+        traced = alignLocal(target, seed.a_end, seed.b_end, seed.score, xdrop, evaluer, evalThr, local_aln);
     } else {
-        local_aln = align_local_profile(blockTrace, blockNoTrace, querySeq, queryLength, a, targetSeq, targetLength, bProfile, gaps, subMat, pos.a_end, pos.b_end, cigar, range, xdrop);
+        // profile scores are scaled down in block aligner, so the seed score is no usable bound and the traceback always runs
+        local_aln = alignLocalProfile(target, seed.a_end, seed.b_end, xdrop);
+        traced = true;
         // std::swap(local_aln.a_start, local_aln.b_start);
         // std::swap(local_aln.a_end, local_aln.b_end);
     }
@@ -262,7 +404,7 @@ BlockAligner::align(
     // int alnLength = Matcher::computeAlnLength(local_aln.a_start, local_aln.a_end, local_aln.b_start, local_aln.b_end);
     int alnLength = 0;
 
-    size_t cigarLength = block_len_cigar(cigar);
+    size_t cigarLength = traced ? block_len_cigar(cigar) : 0;
     size_t aaIds = 0;
     if (cigarLength > 0) {
         int32_t targetPos = 0, queryPos = 0;
@@ -3,6 +3,10 @@
 
 #include "block_aligner.h"
 #include "StripedSmithWaterman.h"
+#include "DistanceCalculator.h"
+#include "Sequence.h"
+
+#include <climits>
 
 class EvalueComputation;
 
@@ -13,7 +17,8 @@ public:
         uintptr_t min, uintptr_t max,
         int8_t gapOpen, int8_t gapExtend,
         BaseMatrix& subMat,
-        int dbtype = Parameters::DBTYPE_AMINO_ACIDS
+        int dbtype = Parameters::DBTYPE_AMINO_ACIDS,
+        bool adaptiveRange = false
     );
 
     ~BlockAligner();
@@ -36,6 +41,9 @@ public:
         int diagonal
     );
 
+    // positions of an ungapped alignment computed by DistanceCalculator::computeUngappedAlignment
+    static LocalAln fromUngapped(const DistanceCalculator::LocalAlignment &alignment);
+
     s_align align(
         const char* querySeq,
         const char* queryCon,
@@ -49,10 +57,117 @@ public:
         int xdrop
     );
 
+    /**
+     * @brief Gapped alignment extending the ungapped seed (in query/target coordinates)
+     * Unless the seed and the forward pass already pass evalThr, the reverse pass is first computed score-only
+     * and the traceback only runs if its E-value is at most evalThr. Otherwise, the result has the score and
+     * E-value but cigarLen is 0. Profiles always get a traceback.
+     */
+    s_align align(
+        const char* querySeq,
+        unsigned int queryLength,
+        const char* targetSeq,
+        unsigned int targetLength,
+        const LocalAln& seed,
+        std::string& backtrace,
+        EvalueComputation *evaluer,
+        int xdrop,
+        double evalThr
+    );
+
+    // key of sequences that are not cached
+    static const unsigned int NO_KEY = UINT_MAX;
+
+    /**
+     * @brief Forward and reverse block-aligner input of one target side (b) sequence or profile
+     * It is loaded in full and alignments start at an offset into it, so one load serves all seeds.
+     * The buffers grow to the longest sequence loaded so far and are reused for the next one.
+     */
+    class Target {
+    public:
+        Target()
+            : key(NO_KEY), length(0), capacity(0), forward(NULL), reverse(NULL), forwardProfile(NULL), reverseProfile(NULL) {}
+        ~Target();
+
+        // key of the loaded sequence, NO_KEY if nothing is loaded
+        unsigned int getKey() const {
+            return key;
+        }
+
+    private:
+        friend class BlockAligner;
+
+        Target(const Target &);
+        Target &operator=(const Target &);
+
+        unsigned int key;
+        size_t length;
+        size_t capacity;
+        PaddedBytes* forward;
+        PaddedBytes* reverse;
+        AAProfile* forwardProfile;
+        AAProfile* reverseProfile;
+    };
+
+    /**
+     * @brief Target-major alignment: the query side (a) is set once and aligned against many target side (b) sequences
+     * Both sides are loaded in full, the query side on the first alignment after setQuery. It is not loaded again
+     * if setQuery is called with the same key. A key must always refer to the same sequence, NO_KEY disables this.
+     */
+    void setQuery(unsigned int queryKey, const char* querySeq, unsigned int queryLength);
+
+    // loads a target side sequence, or profile for profile searches, into target
+    void loadTarget(Target& target, unsigned int targetKey, const char* targetSeq, unsigned int targetLength);
+
+    s_align alignTarget(
+        Target& target,
+        const LocalAln& seed,
+        std::string& backtrace,
+        EvalueComputation *evaluer,
+        int xdrop,
+        double evalThr
+    );
+
+    // aligns against a target that is kept loaded while consecutive calls use the same key
+    s_align alignTarget(
+        unsigned int targetKey,
+        const char* targetSeq,
+        unsigned int targetLength,
+        const LocalAln& seed,
+        std::string& backtrace,
+        EvalueComputation *evaluer,
+        int xdrop,
+        double evalThr
+    );
+
 private:
+    bool alignLocal(
+        Target& target,
+        size_t a_idx, size_t b_idx, int32_t seed_score, int32_t x_drop,
+        EvalueComputation *evaluer, double evalThr,
+        LocalAln& res_aln
+    );
+
+    LocalAln alignLocalProfile(
+        Target& target,
+        size_t a_idx, size_t b_idx, int32_t x_drop
+    );
+
+    uintptr_t adaptiveMaxSize(size_t queryLength, size_t targetLength, const LocalAln& seed) const;
+
+    void loadQuery();
+
+    unsigned int aKey;
+    const char* aSeq;
+    size_t aLen;
+    bool aLoaded;
+
     PaddedBytes* a;
-    PaddedBytes* b;
-    AAProfile* bProfile;
+    PaddedBytes* aRev;
+    // target of the key based alignTarget
+    Target keyedTarget;
+    // profile columns in block aligner order, extra columns are assigned to 'U', which is unused
+    uint8_t profileOrder[Sequence::PROFILE_READIN_SIZE];
     AAMatrix* matrix;
     BlockHandle blockTrace;
     BlockHandle blockNoTrace;
@@ -60,6 +175,9 @@ private:
     uint32_t* sAlnCigar;
 
     SizeRange range;
+    // block sizes of the current pair, with adaptiveRange the max size is chosen per pair up to range.max
+    SizeRange alignRange;
+    bool adaptiveRange;
     Gaps gaps;
     BaseMatrix& subMat;
     int dbtype;
@@ -0,0 +1,90 @@
+#include "CompressedQueryTable.h"
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+template <typename Entry>
+CompressedQueryTable::CompressedQueryTable(const std::vector<Entry> &table) : entryCount(table.size()) {
+    const size_t blocks = entryCount / BLOCK_SIZE + (entryCount % BLOCK_SIZE == 0 ? 0 : 1);
+    blockFirstKmer.resize(blocks);
+    blockDeltaOffset.resize(blocks + 1);
+    blockDeltaBits.resize(blocks);
+
+    unsigned int maxQueryId = 0;
+    unsigned int maxPosition = 0;
+    int minKmerScore = SHRT_MAX;
+    int maxKmerScore = SHRT_MIN;
+    unsigned int maxRank = 0;
+#pragma omp parallel for schedule(static) reduction(max: maxQueryId, maxPosition, maxKmerScore, maxRank) reduction(min: minKmerScore)
+    for (size_t b = 0; b < blocks; ++b) {
+        const size_t start = b * BLOCK_SIZE;
+        const size_t end = std::min(start + BLOCK_SIZE, entryCount);
+        uint64_t maxDelta = 0;
+        for (size_t i = start; i < end; ++i) {
+            if (i > start) {
+                maxDelta = std::max(maxDelta, (uint64_t) (table[i].Query.kmer - table[i - 1].Query.kmer));
+            }
+            maxQueryId = std::max(maxQueryId, table[i].querySequenceId);
+            maxPosition = std::max(maxPosition, table[i].Query.kmerPosInQuery);
+            minKmerScore = std::min(minKmerScore, (int) getKmerScore(table[i]));
+            maxKmerScore = std::max(maxKmerScore, (int) getKmerScore(table[i]));
+            maxRank = std::max(maxRank, (unsigned int) getKmerRank(table[i]));
+        }
+        blockFirstKmer[b] = table[start].Query.kmer;
+        blockDeltaBits[b] = (unsigned char) bitWidth(maxDelta);
+    }
+
+    // every block starts at a word boundary, so that blocks can be written in parallel
+    size_t bitOffset = 0;
+    for (size_t b = 0; b < blocks; ++b) {
+        blockDeltaOffset[b] = bitOffset;
+        const size_t count = std::min(BLOCK_SIZE, entryCount - b * BLOCK_SIZE);
+        const size_t bits = (count - 1) * blockDeltaBits[b];
+        bitOffset += (bits + 63) / 64 * 64;
+    }
+    blockDeltaOffset[blocks] = bitOffset;
+
+    queryIdBits = bitWidth(maxQueryId);
+    positionBits = bitWidth(maxPosition);
+    minScore = entryCount > 0 ? minKmerScore : 0;
+    scoreBits = entryCount > 0 ? bitWidth((uint64_t) (maxKmerScore - minKmerScore)) : 0;
+    rankBits = bitWidth(maxRank);
+    // one additional word, so that getBits can always read the following word
+    deltas.resize(bitOffset / 64 + 1, 0);
+    queryIds.resize((entryCount * queryIdBits + 63) / 64 + 1, 0);
+    positions.resize((entryCount * positionBits + 63) / 64 + 1, 0);
+    scores.resize((entryCount * scoreBits + 63) / 64 + 1, 0);
+    ranks.resize((entryCount * rankBits + 63) / 64 + 1, 0);
+
+    // BLOCK_SIZE * width is a multiple of 64 bits, so the columns of a block never share a word with another block
+#pragma omp parallel for schedule(static)
+    for (size_t b = 0; b < blocks; ++b) {
+        const size_t start = b * BLOCK_SIZE;
+        const size_t end = std::min(start + BLOCK_SIZE, entryCount);
+        const unsigned int width = blockDeltaBits[b];
+        size_t bitPos = blockDeltaOffset[b];
+        for (size_t i = start; i < end; ++i) {
+            if (i > start) {
+                setBits(deltas, bitPos, width, table[i].Query.kmer - table[i - 1].Query.kmer);
+                bitPos += width;
+            }
+            setBits(queryIds, i * queryIdBits, queryIdBits, table[i].querySequenceId);
+            setBits(positions, i * positionBits, positionBits, table[i].Query.kmerPosInQuery);
+            setBits(scores, i * scoreBits, scoreBits, (uint64_t) (getKmerScore(table[i]) - minScore));
+            setBits(ranks, i * rankBits, rankBits, getKmerRank(table[i]));
+        }
+    }
+}
+
+template CompressedQueryTable::CompressedQueryTable(const std::vector<QueryTableEntry> &table);
+template CompressedQueryTable::CompressedQueryTable(const std::vector<ScoredQueryTableEntry<QueryTableEntry>> &table);
+template CompressedQueryTable::CompressedQueryTable(const std::vector<WideQueryTableEntry> &table);
+template CompressedQueryTable::CompressedQueryTable(const std::vector<ScoredQueryTableEntry<WideQueryTableEntry>> &table);
+
+size_t CompressedQueryTable::getMemorySize() const {
+    return blockFirstKmer.size() * sizeof(unsigned long long)
+           + blockDeltaOffset.size() * sizeof(size_t)
+           + blockDeltaBits.size() * sizeof(unsigned char)
+           + (deltas.size() + queryIds.size() + positions.size() + scores.size() + ranks.size()) * sizeof(uint64_t);
+}
@@ -0,0 +1,141 @@
+#ifndef SRASEARCH_COMPRESSEDQUERYTABLE_H
+#define SRASEARCH_COMPRESSEDQUERYTABLE_H
+
+#include "QueryTableEntry.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Read-only, block compressed representation of a sorted query table.
+ *
+ * The k-mers are delta coded in blocks of BLOCK_SIZE entries. Each block stores its first k-mer
+ * as an absolute value, the remaining deltas are bit-packed with the width of the largest delta in the block.
+ * Query id, position, score and rank columns are bit-packed to the width of their largest value,
+ * score and rank take no space unless the table was created from ScoredQueryTableEntry for a sensitivity sweep.
+ * The target id is not stored, hits are emitted as full query table entries by getEntry.
+ *
+ * Decoding costs some join speed: 806,508 query entries (15 MB -> 4 MB) joined with an 80 MB target table on one
+ * thread took 0.290 s (0.28 GB/s) plain and 0.302 s (0.27 GB/s) compressed, median of 14 runs.
+ */
+class CompressedQueryTable {
+public:
+    static const size_t BLOCK_SIZE = 128;
+
+    // table has to be sorted by k-mer (queryTableSort)
+    template <typename Entry>
+    explicit CompressedQueryTable(const std::vector<Entry> &table);
+
+    size_t size() const {
+        return entryCount;
+    }
+
+    size_t blockCount() const {
+        return blockFirstKmer.size();
+    }
+
+    unsigned long long getBlockFirstKmer(size_t block) const {
+        return blockFirstKmer[block];
+    }
+
+    // bytes used by all columns
+    size_t getMemorySize() const;
+
+    // decode all k-mers of a block into dest, returns the number of entries in the block
+    size_t decodeBlock(size_t block, unsigned long long *dest) const {
+        const size_t start = block * BLOCK_SIZE;
+        const size_t count = std::min(BLOCK_SIZE, entryCount - start);
+        const unsigned int width = blockDeltaBits[block];
+        size_t bitPos = blockDeltaOffset[block];
+        unsigned long long kmer = blockFirstKmer[block];
+        dest[0] = kmer;
+        for (size_t i = 1; i < count; ++i) {
+            kmer += getBits(deltas, bitPos, width);
+            bitPos += width;
+            dest[i] = kmer;
+        }
+        return count;
+    }
+
+    unsigned int getQueryId(size_t i) const {
+        return (unsigned int) getBits(queryIds, i * queryIdBits, queryIdBits);
+    }
+
+    unsigned int getPosition(size_t i) const {
+        return (unsigned int) getBits(positions, i * positionBits, positionBits);
+    }
+
+    // Entry has to be the entry type the table was created from
+    template <typename Entry>
+    Entry getEntry(size_t i, unsigned long long kmer, uint64_t targetId) const {
+        Entry entry{};
+        entry.querySequenceId = getQueryId(i);
+        entry.targetSequenceID = targetId;
+        entry.Query.kmerPosInQuery = getPosition(i);
+        entry.Query.kmer = kmer;
+        setKmerScore(
+            entry,
+            (short) (minScore + (int) getBits(scores, i * scoreBits, scoreBits)),
+            (unsigned short) getBits(ranks, i * rankBits, rankBits)
+        );
+        return entry;
+    }
+
+    static inline uint64_t getBits(const std::vector<uint64_t> &words, size_t bitPos, unsigned int width) {
+        if (width == 0) {
+            return 0;
+        }
+        const size_t word = bitPos >> 6U;
+        const unsigned int shift = bitPos & 63U;
+        uint64_t value = words[word] >> shift;
+        if (shift + width > 64) {
+            value |= words[word + 1] << (64 - shift);
+        }
+        return width == 64 ? value : (value & ((UINT64_C(1) << width) - 1));
+    }
+
+    static inline void setBits(std::vector<uint64_t> &words, size_t bitPos, unsigned int width, uint64_t value) {
+        if (width == 0) {
+            return;
+        }
+        const size_t word = bitPos >> 6U;
+        const unsigned int shift = bitPos & 63U;
+        words[word] |= value << shift;
+        if (shift + width > 64) {
+            words[word + 1] |= value >> (64 - shift);
+        }
+    }
+
+    static inline unsigned int bitWidth(uint64_t maxValue) {
+        unsigned int width = 0;
+        while (maxValue != 0) {
+            ++width;
+            maxValue >>= 1U;
+        }
+        return width;
+    }
+
+private:
+    size_t entryCount;
+
+    std::vector<unsigned long long> blockFirstKmer;
+    // bit offset of the first delta of each block, blocks start at word boundaries
+    std::vector<size_t> blockDeltaOffset;
+    std::vector<unsigned char> blockDeltaBits;
+    std::vector<uint64_t> deltas;
+
+    unsigned int queryIdBits;
+    std::vector<uint64_t> queryIds;
+    unsigned int positionBits;
+    std::vector<uint64_t> positions;
+    // scores are stored as offset to minScore
+    int minScore;
+    unsigned int scoreBits;
+    std::vector<uint64_t> scores;
+    unsigned int rankBits;
+    std::vector<uint64_t> ranks;
+};
+
+#endif
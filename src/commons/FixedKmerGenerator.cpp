@@ -1,10 +1,8 @@
 #include "FixedKmerGenerator.h"
+#include "Util.h"
 #include <algorithm>
-#include <vector>
-#include <queue>
-#include <unordered_set>
-#include <numeric>
-#include <tuple>
+#include <climits>
+#include <cstring>
 
 FixedKmerGenerator::FixedKmerGenerator(size_t kmerSize, size_t alphabetSize, short threshold, unsigned int maxKmers)
     : kmerSize(kmerSize), threshold(threshold), maxKmers(maxKmers), indexer((int) alphabetSize, (int)kmerSize) {}
@@ -14,8 +12,15 @@ FixedKmerGenerator::~FixedKmerGenerator() {
     delete[] divideStep;
     delete[] matrixLookup;
     delete[] outputIndexArray;
+    delete[] outputScoreArray;
     delete[] scoreArrays;
     delete[] indexArrays;
+    delete[] heap;
+    delete[] nodeIndices;
+    delete[] visitedNode;
+    delete[] packedHeap;
+    delete[] visitedState;
+    delete[] visitedStamp;
 }
 
 void FixedKmerGenerator::setThreshold(short threshold) {
@@ -83,210 +88,88 @@ void FixedKmerGenerator::setDivideStrategy(ScoreMatrix* three, ScoreMatrix* two)
 void FixedKmerGenerator::initDataStructure() {
     stepMultiplicator = new size_t[divideStepCount];
     outputIndexArray = (size_t *) mem_align(ALIGN_INT, maxKmers * sizeof(size_t));
+    outputScoreArray = new short[maxKmers];
     scoreArrays = new std::pair<short *, int>[divideStepCount];
     indexArrays = new std::pair<unsigned int*, int>[divideStepCount];
-}
-
-template <typename T>
-bool comp(const T& a, const T& b) {
-    return std::get<0>(a) < std::get<0>(b);
-}
-
-struct pair_hash_fn {
-    template <class T>
-    inline void hash_combine(std::size_t& seed, T const& v) const {
-        std::hash<T> hasher;
-        seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
-    }
 
-    template <class Pair>
-    inline std::size_t operator()(Pair const& t) const
-    {
-        std::size_t seed = 0;
-        hash_combine(seed, t.first);
-        hash_combine(seed, t.second);
-        return seed;
+    // a row index can only grow by one per pop, so no index exceeds maxKmers
+    size_t maxIndex = 0;
+    for (size_t i = 0; i < divideStepCount; i++) {
+        maxIndex = std::max(maxIndex, std::min(matrixLookup[i]->rowSize - 1, (size_t) maxKmers));
     }
-};
-
-struct tuple_hash_fn {
-    template <class T>
-    inline void hash_combine(std::size_t& seed, T const& v) const
-    {
-        std::hash<T> hasher;
-        seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+    packedStateBits = 0;
+    while ((maxIndex >> packedStateBits) != 0) {
+        packedStateBits++;
     }
+    usePackedStates = packedStateBits * divideStepCount <= 64;
 
-    template <class Tuple>
-    inline std::size_t operator()(Tuple const& t) const {
-        std::size_t seed = 0;
-        hash_combine(seed, std::get<0>(t));
-        hash_combine(seed, std::get<1>(t));
-        hash_combine(seed, std::get<2>(t));
-        return seed;
+    nodeCapacity = 1 + (size_t) maxKmers * divideStepCount;
+    size_t visitedSize = 1;
+    while (visitedSize < 2 * nodeCapacity) {
+        visitedSize <<= 1;
     }
-};
-
-
-std::pair<std::vector<unsigned int>, std::vector<std::tuple<unsigned int, unsigned int, unsigned int>>> topScoringKmers2(std::pair<short*, int>* scores,std::pair<unsigned int*, int>* indices, int N) {
-    std::vector<std::tuple<int, int, int>> queue;
-    std::unordered_set<std::pair<int, int>, pair_hash_fn> visited;
-
-    queue.emplace_back(scores[0].first[0] + scores[1].first[0], 0, 0);
-    std::push_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int>>);
-    visited.emplace(0, 0);
-
-    std::vector<unsigned int> result;
-    std::vector<std::tuple<unsigned int, unsigned int, unsigned int>> indexResult;
-
-    for (int _ = 0; _ < N; ++_) {
-        std::pop_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int>>);
-        const std::tuple<int, int, int>& back = queue.back();
-        int total = std::get<0>(back);
-        int i = std::get<1>(back);
-        int j = std::get<2>(back);
-        queue.pop_back();
-
-        result.emplace_back(total);
-        indexResult.emplace_back(indices[0].first[i], indices[1].first[j], 0);
-
-        if (i + 1 < scores[0].second && visited.find({i + 1, j}) == visited.end()) {
-            queue.emplace_back(scores[0].first[i + 1] + scores[1].first[j], i + 1, j);
-            std::push_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int>>);
-            visited.emplace(i + 1, j);
-        }
-
-        if (j + 1 < scores[1].second && visited.find({i, j + 1}) == visited.end()) {
-            queue.emplace_back(scores[0].first[i] + scores[1].first[j + 1], i, j + 1);
-            std::push_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int>>);
-            visited.emplace(i, j + 1);
-        }
+    visitedMask = visitedSize - 1;
+    heap = NULL;
+    nodeIndices = NULL;
+    visitedNode = NULL;
+    packedHeap = NULL;
+    visitedState = NULL;
+    if (usePackedStates) {
+        packedHeap = new PackedHeapEntry[nodeCapacity];
+        visitedState = new uint64_t[visitedSize];
+    } else {
+        heap = new HeapEntry[nodeCapacity];
+        nodeIndices = new unsigned int[(nodeCapacity + 1) * divideStepCount];
+        visitedNode = new unsigned int[visitedSize];
     }
-
-    return {result, indexResult};
+    visitedStamp = new unsigned int[visitedSize];
+    memset(visitedStamp, 0, visitedSize * sizeof(unsigned int));
+    currentStamp = 0;
 }
 
-std::pair<std::vector<unsigned int>, std::vector<std::tuple<unsigned int, unsigned int, unsigned int>>> topScoringKmers3(std::pair<short*, int>* scores, std::pair<unsigned int*, int>* indices, int N) {
-    std::vector<std::tuple<int, int, int, int>> queue;
-    std::unordered_set<std::tuple<int, int, int>, tuple_hash_fn> visited;
-
-    queue.emplace_back(scores[0].first[0] + scores[1].first[0] + scores[2].first[0], 0, 0, 0);
-    std::push_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int, int>>);
-    visited.emplace(0, 0, 0);
-
-    std::vector<unsigned int> result;
-    result.reserve(N);
-    std::vector<std::tuple<unsigned int, unsigned int, unsigned int>> indexResult;
-    indexResult.reserve(N);
-
-    for (int _ = 0; _ < N; ++_) {
-        std::pop_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int, int>>);
-        const std::tuple<int, int, int, int>& back = queue.back();
-        int total = std::get<0>(back);
-        int i = std::get<1>(back);
-        int j = std::get<2>(back);
-        int k = std::get<3>(back);
-        queue.pop_back();
-
-        result.emplace_back(total);
-        indexResult.emplace_back(indices[0].first[i], indices[1].first[j], indices[2].first[k]);
-
-        if (i + 1 < scores[0].second && visited.find({i + 1, j, k}) == visited.end()) {
-            queue.emplace_back(scores[0].first[i + 1] + scores[1].first[j] + scores[2].first[k], i + 1, j, k);
-            std::push_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int, int>>);
-            visited.emplace(i + 1, j, k);
-        }
-
-        if (j + 1 < scores[1].second && visited.find({i, j + 1, k}) == visited.end()) {
-            queue.emplace_back(scores[0].first[i] + scores[1].first[j + 1] + scores[2].first[k], i, j + 1, k);
-            std::push_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int, int>>);
-            visited.emplace(i, j + 1, k);
-        }
-
-        if (k + 1 < scores[2].second && visited.find({i, j, k + 1}) == visited.end()) {
-            queue.emplace_back(scores[0].first[i] + scores[1].first[j] + scores[2].first[k + 1], i, j, k + 1);
-            std::push_heap(queue.begin(), queue.end(), comp<std::tuple<int, int, int, int>>);
-            visited.emplace(i, j, k + 1);
-        }
+void FixedKmerGenerator::resetVisited() {
+    ++currentStamp;
+    if (UNLIKELY(currentStamp == 0)) {
+        memset(visitedStamp, 0, (visitedMask + 1) * sizeof(unsigned int));
+        currentStamp = 1;
     }
-
-    return {result, indexResult};
 }
 
-
-struct any_hash_fn {
-    template <class T>
-    inline void hash_combine(std::size_t& seed, T const& v) const {
-        std::hash<T> hasher;
-        seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+bool FixedKmerGenerator::markVisited(unsigned int node) {
+    const unsigned int *indices = &nodeIndices[node * divideStepCount];
+    size_t hash = 0;
+    for (size_t i = 0; i < divideStepCount; ++i) {
+        hash = (hash ^ indices[i]) * 0x9e3779b97f4a7c15ULL;
     }
-
-    template <class Pair>
-    inline std::size_t operator()(Pair const& t) const
-    {
-        std::size_t seed = 0;
-        for (size_t i = 0; i < t.size(); ++i) {
-            hash_combine(seed, t[i]);
+    size_t slot = (hash >> 32U) & visitedMask;
+    while (visitedStamp[slot] == currentStamp) {
+        if (memcmp(&nodeIndices[visitedNode[slot] * divideStepCount], indices, divideStepCount * sizeof(unsigned int)) == 0) {
+            return false;
         }
-        return seed;
-    }
-};
-
-std::pair<std::vector<unsigned int>, std::vector<std::vector<unsigned int>>> topScoringKmers(std::pair<short*, int>* scores, std::pair<unsigned int*, int>* indices, int N, int numScores) {
-    std::vector<std::pair<int, std::vector<int>>> queue;
-    std::unordered_set<std::vector<int>, any_hash_fn> visited;
-
-    std::vector<int> idx(numScores, 0);
-    int total = 0;
-    for (int i = 0; i < numScores; ++i) {
-        total += scores[i].first[0];
+        slot = (slot + 1) & visitedMask;
     }
+    visitedStamp[slot] = currentStamp;
+    visitedNode[slot] = node;
+    return true;
+}
 
-    queue.emplace_back(total, idx);
-    std::push_heap(queue.begin(), queue.end(), comp<std::pair<int, std::vector<int>>>);
-    visited.emplace(idx);
-
-    std::vector<unsigned int> result;
-    result.reserve(N);
-    std::vector<std::vector<unsigned int>> indexResult;
-    indexResult.reserve(N);
-
-    for (int _ = 0; _ < N; ++_) {
-        std::pop_heap(queue.begin(), queue.end(), comp<std::pair<int, std::vector<int>>>);
-        const std::pair<int, std::vector<int>>& back = queue.back();
-        total = back.first;
-        idx = back.second;
-        queue.pop_back();
-
-        result.emplace_back(total);
-        std::vector<unsigned int> currIndexResult;
-        for (int i = 0; i < numScores; ++i) {
-            currIndexResult.push_back(indices[i].first[idx[i]]);
-        }
-        indexResult.emplace_back(currIndexResult);
-
-        for (int i = 0; i < numScores; ++i) {
-            if (idx[i] + 1 < scores[i].second) {
-                std::vector<int> newIdx = idx;
-                newIdx[i] += 1;
-                if (visited.find(newIdx) == visited.end()) {
-                    total = 0;
-                    for (int j = 0; j < numScores; ++j) {
-                        total += scores[j].first[newIdx[j]];
-                    }
-                    queue.emplace_back(total, newIdx);
-                    std::push_heap(queue.begin(), queue.end(), comp<std::pair<int, std::vector<int>>>);
-                    visited.emplace(newIdx);
-                }
-            }
+bool FixedKmerGenerator::markVisited(uint64_t state) {
+    size_t slot = ((state * 0x9e3779b97f4a7c15ULL) >> 32U) & visitedMask;
+    while (visitedStamp[slot] == currentStamp) {
+        if (visitedState[slot] == state) {
+            return false;
         }
+        slot = (slot + 1) & visitedMask;
     }
-
-    return {result, indexResult};
+    visitedStamp[slot] = currentStamp;
+    visitedState[slot] = state;
+    return true;
 }
 
 std::pair<size_t *, size_t> FixedKmerGenerator::generateKmerList(const unsigned char * int_seq, bool /* addIdentity */) {
     int dividerBefore = 0;
+    // the first entry of each sorted score row is its maximum, their sum bounds every generated k-mer
+    int maxScore = 0;
     for (size_t i = 0; i < divideStepCount; i++) {
         const int divider = divideStep[i];
         const unsigned int index = indexer.int2index(int_seq, dividerBefore, dividerBefore+divider);
@@ -296,48 +179,101 @@ std::pair<size_t *, size_t> FixedKmerGenerator::generateKmerList(const unsigned
         const ScoreMatrix* nextScoreMatrix = matrixLookup[i];
         short* nextScoreArray = &nextScoreMatrix->score[index*nextScoreMatrix->rowSize];
         scoreArrays[i] = std::make_pair(nextScoreArray, (int)nextScoreMatrix->rowSize);
+        maxScore += nextScoreArray[0];
 
         unsigned int* nextIndexArray = &nextScoreMatrix->index[index*nextScoreMatrix->rowSize];
         indexArrays[i] = std::make_pair(nextIndexArray, (int)nextScoreMatrix->rowSize);
     }
-    
-    if (divideStepCount > 3) {
-        std::pair<std::vector<unsigned int>, std::vector<std::vector<unsigned int>>> res = topScoringKmers(scoreArrays, indexArrays, maxKmers, divideStepCount);
-        size_t generated = 0;
-        for (size_t i = 0; i < res.first.size(); i++) {
-            unsigned int score = res.first[i];
-            size_t index = 0;
-            for (size_t j = 0; j < res.second[i].size(); ++j) {
-                index += static_cast<size_t>(res.second[i][j]) * stepMultiplicator[j];
+    if (maxScore < threshold) {
+        return std::make_pair(outputIndexArray, 0);
+    }
+
+    resetVisited();
+    const size_t generated = usePackedStates ? searchPackedStates(maxScore) : searchNodes(maxScore);
+    return std::make_pair(outputIndexArray, generated);
+}
+
+// Best-first search over the index tuples of the sorted score rows. The heap sees the same pushes and
+// pops in the same order as a std::push_heap/std::pop_heap search over all children would, so k-mers
+// with equal scores are returned in the same order as well.
+size_t FixedKmerGenerator::searchNodes(int maxScore) {
+    auto heapComp = [](const HeapEntry &a, const HeapEntry &b) { return a.score < b.score; };
+    unsigned int nodeCount = 0;
+    memset(nodeIndices, 0, divideStepCount * sizeof(unsigned int));
+    markVisited(nodeCount);
+    size_t heapSize = 0;
+    heap[heapSize++] = HeapEntry{maxScore, nodeCount++};
+
+    size_t generated = 0;
+    for (unsigned int n = 0; n < maxKmers && heapSize > 0; ++n) {
+        std::pop_heap(heap, heap + heapSize, heapComp);
+        const HeapEntry top = heap[--heapSize];
+        // scores of popped entries never increase, nothing that follows can reach the threshold
+        if (top.score < threshold) {
+            break;
+        }
+
+        const unsigned int *indices = &nodeIndices[top.node * divideStepCount];
+        size_t index = 0;
+        for (size_t i = 0; i < divideStepCount; ++i) {
+            index += static_cast<size_t>(indexArrays[i].first[indices[i]]) * stepMultiplicator[i];
+        }
+        outputScoreArray[generated] = (short) std::min(top.score, (int) SHRT_MAX);
+        outputIndexArray[generated++] = index;
+
+        for (size_t i = 0; i < divideStepCount; ++i) {
+            if ((int) indices[i] + 1 >= scoreArrays[i].second) {
+                continue;
             }
-            if (score >= (unsigned int)threshold) {
-                outputIndexArray[generated++] = index;
+            unsigned int *child = &nodeIndices[nodeCount * divideStepCount];
+            memcpy(child, indices, divideStepCount * sizeof(unsigned int));
+            child[i] += 1;
+            if (markVisited(nodeCount)) {
+                const int score = top.score - scoreArrays[i].first[indices[i]] + scoreArrays[i].first[child[i]];
+                heap[heapSize++] = HeapEntry{score, nodeCount++};
+                std::push_heap(heap, heap + heapSize, heapComp);
             }
         }
+    }
+    return generated;
+}
 
-        return std::make_pair(outputIndexArray, generated);
-    } else {
-        std::pair<std::vector<unsigned int>, std::vector<std::tuple<unsigned int, unsigned int, unsigned int>>> res;
-        if (divideStepCount == 2) {
-            res = topScoringKmers2(scoreArrays, indexArrays, maxKmers);
-        } else if (divideStepCount == 3) {
-            res = topScoringKmers3(scoreArrays, indexArrays, maxKmers);
+// Same search as searchNodes with the index tuple packed into packedStateBits per divide step
+size_t FixedKmerGenerator::searchPackedStates(int maxScore) {
+    auto heapComp = [](const PackedHeapEntry &a, const PackedHeapEntry &b) { return a.score < b.score; };
+    const uint64_t indexMask = (UINT64_C(1) << packedStateBits) - 1;
+    markVisited((uint64_t) 0);
+    size_t heapSize = 0;
+    packedHeap[heapSize++] = PackedHeapEntry{maxScore, 0};
+
+    size_t generated = 0;
+    for (unsigned int n = 0; n < maxKmers && heapSize > 0; ++n) {
+        std::pop_heap(packedHeap, packedHeap + heapSize, heapComp);
+        const PackedHeapEntry top = packedHeap[--heapSize];
+        if (top.score < threshold) {
+            break;
         }
 
-        size_t generated = 0;
-        for (size_t i = 0; i < res.first.size(); i++) {
-            unsigned int score = res.first[i];
-            size_t index = 0;
-            index += static_cast<size_t>(std::get<0>(res.second[i])) * stepMultiplicator[0];
-            index += static_cast<size_t>(std::get<1>(res.second[i])) * stepMultiplicator[1];
-            if (divideStepCount == 3) {
-                index += static_cast<size_t>(std::get<2>(res.second[i])) * stepMultiplicator[2];
+        size_t index = 0;
+        for (size_t i = 0; i < divideStepCount; ++i) {
+            const unsigned int rowIndex = (top.state >> (i * packedStateBits)) & indexMask;
+            index += static_cast<size_t>(indexArrays[i].first[rowIndex]) * stepMultiplicator[i];
+        }
+        outputScoreArray[generated] = (short) std::min(top.score, (int) SHRT_MAX);
+        outputIndexArray[generated++] = index;
+
+        for (size_t i = 0; i < divideStepCount; ++i) {
+            const unsigned int rowIndex = (top.state >> (i * packedStateBits)) & indexMask;
+            if ((int) rowIndex + 1 >= scoreArrays[i].second) {
+                continue;
             }
-            if (score >= (unsigned int)threshold) {
-                outputIndexArray[generated++] = index;
+            const uint64_t child = top.state + (UINT64_C(1) << (i * packedStateBits));
+            if (markVisited(child)) {
+                const int score = top.score - scoreArrays[i].first[rowIndex] + scoreArrays[i].first[rowIndex + 1];
+                packedHeap[heapSize++] = PackedHeapEntry{score, child};
+                std::push_heap(packedHeap, packedHeap + heapSize, heapComp);
             }
         }
-
-        return std::make_pair(outputIndexArray, generated);
     }
+    return generated;
 }
@@ -1,5 +1,6 @@
 #ifndef FIXED_KMERGENERATOR_H 
 #define FIXED_KMERGENERATOR_H 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <Indexer.h>
@@ -13,6 +14,11 @@ class FixedKmerGenerator {
         // calculates the kmer list
         std::pair<size_t *, size_t> generateKmerList(const unsigned char* intSeq, bool addIdentity = false);
 
+        // scores of the k-mers of the last generateKmerList call, in the same (descending) order
+        const short *getKmerScores() const {
+            return outputScoreArray;
+        }
+
         // kmer splitting stragety (3,2)
         // fill up the divide step and calls init_result_list
         void setDivideStrategy(ScoreMatrix* three, ScoreMatrix* two);
@@ -44,8 +50,46 @@ class FixedKmerGenerator {
         std::pair<short *, int>* scoreArrays;
         std::pair<unsigned int*, int>* indexArrays;
 
+        // scratch space of the best-first search, allocated once in initDataStructure
+        struct HeapEntry {
+            int score;
+            unsigned int node;
+        };
+        struct PackedHeapEntry {
+            int score;
+            uint64_t state;
+        };
+        // every pop expands at most divideStepCount children, so at most 1 + maxKmers * divideStepCount nodes exist
+        size_t nodeCapacity;
+        HeapEntry* heap;
+        // per node the row index of each divide step
+        unsigned int* nodeIndices;
+        // open addressing set of visited nodes, slots of older calls are invalidated through visitedStamp
+        size_t visitedMask;
+        unsigned int* visitedNode;
+        unsigned int* visitedStamp;
+        unsigned int currentStamp;
+
+        // If the row indices of all divide steps fit into 64 bits, nodes are packed into a single integer
+        // instead of being stored in nodeIndices. Profile queries use one step per position with 32 wide
+        // rows, so 5 bits per step cover them up to k=12.
+        bool usePackedStates;
+        unsigned int packedStateBits;
+        PackedHeapEntry* packedHeap;
+        uint64_t* visitedState;
+
         // init the output vectors for the kmer calculation
         void initDataStructure();
+
+        // returns true if the index tuple of node was not visited before and marks it visited
+        bool markVisited(unsigned int node);
+        bool markVisited(uint64_t state);
+
+        // starts a new search, invalidates the visited set of the previous one
+        void resetVisited();
+
+        size_t searchNodes(int maxScore);
+        size_t searchPackedStates(int maxScore);
 };
 
 #endif
@@ -0,0 +1,128 @@
+#include "HotKmerPostings.h"
+#include "Debug.h"
+#include "FileUtil.h"
+#include "Util.h"
+
+void HotKmerPostings::add(unsigned long long kmer, const std::vector<uint64_t> &ids) {
+    kmers.emplace_back(kmer);
+    size_t start = 0;
+    while (start < ids.size()) {
+        const uint64_t high = ids[start] >> 16U;
+        size_t end = start;
+        while (end < ids.size() && (ids[end] >> 16U) == high) {
+            ++end;
+        }
+        const unsigned int cardinality = (unsigned int) (end - start);
+        Container container;
+        container.high = (uint32_t) high;
+        container.cardinalityMinusOne = (uint16_t) (cardinality - 1);
+        const size_t offset = data.size();
+        data.resize(data.size() + getContainerWords(cardinality), 0);
+        if (cardinality > ARRAY_MAX_SIZE) {
+            uint64_t *words = data.data() + offset;
+            for (size_t j = start; j < end; ++j) {
+                const unsigned int low = ids[j] & 0xffffU;
+                words[low >> 6U] |= UINT64_C(1) << (low & 63U);
+            }
+        } else {
+            uint16_t *low = (uint16_t *) (data.data() + offset);
+            for (size_t j = start; j < end; ++j) {
+                low[j - start] = (uint16_t) (ids[j] & 0xffffU);
+            }
+        }
+        containers.emplace_back(container);
+        containerOffsets.emplace_back(offset);
+        start = end;
+    }
+    kmerContainerStart.emplace_back(containers.size());
+}
+
+size_t HotKmerPostings::getIdCount(size_t i) const {
+    size_t count = 0;
+    for (size_t c = kmerContainerStart[i]; c < kmerContainerStart[i + 1]; ++c) {
+        count += (size_t) containers[c].cardinalityMinusOne + 1;
+    }
+    return count;
+}
+
+template <typename T>
+static void writeVector(FILE *handle, const std::vector<T> &vector, const std::string &fileName) {
+    const uint64_t size = vector.size();
+    if (fwrite(&size, sizeof(uint64_t), 1, handle) != 1
+        || fwrite(vector.data(), sizeof(T), vector.size(), handle) != vector.size()) {
+        Debug(Debug::ERROR) << "Cannot write " << fileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+template <typename T>
+static void readVector(FILE *handle, std::vector<T> &vector, const std::string &fileName) {
+    uint64_t size;
+    if (fread(&size, sizeof(uint64_t), 1, handle) != 1) {
+        Debug(Debug::ERROR) << "Cannot read " << fileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    vector.resize(size);
+    if (fread(vector.data(), sizeof(T), size, handle) != size) {
+        Debug(Debug::ERROR) << "Cannot read " << fileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+void HotKmerPostings::write(const std::string &tableName) const {
+    const std::string fileName = tableName + "_hot";
+    FILE *handle = fopen(fileName.c_str(), "wb");
+    if (handle == NULL) {
+        Debug(Debug::ERROR) << "Cannot open " << fileName << " for writing\n";
+        EXIT(EXIT_FAILURE);
+    }
+    std::vector<uint32_t> kmerContainerCount(kmers.size());
+    for (size_t i = 0; i < kmers.size(); ++i) {
+        kmerContainerCount[i] = (uint32_t) (kmerContainerStart[i + 1] - kmerContainerStart[i]);
+    }
+    const uint64_t magic = FORMAT_MAGIC;
+    if (fwrite(&magic, sizeof(uint64_t), 1, handle) != 1) {
+        Debug(Debug::ERROR) << "Cannot write " << fileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    writeVector(handle, kmers, fileName);
+    writeVector(handle, kmerContainerCount, fileName);
+    writeVector(handle, containers, fileName);
+    writeVector(handle, data, fileName);
+    if (fclose(handle) != 0) {
+        Debug(Debug::ERROR) << "Cannot close " << fileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+bool HotKmerPostings::read(const std::string &tableName) {
+    const std::string fileName = tableName + "_hot";
+    if (FileUtil::fileExists(fileName.c_str()) == false) {
+        return false;
+    }
+    FILE *handle = FileUtil::openFileOrDie(fileName.c_str(), "rb", true);
+    uint64_t magic;
+    if (fread(&magic, sizeof(uint64_t), 1, handle) != 1 || magic != FORMAT_MAGIC) {
+        Debug(Debug::ERROR) << fileName << " was written by an older version of mergekmertables, please merge the table again\n";
+        EXIT(EXIT_FAILURE);
+    }
+    std::vector<uint32_t> kmerContainerCount;
+    readVector(handle, kmers, fileName);
+    readVector(handle, kmerContainerCount, fileName);
+    readVector(handle, containers, fileName);
+    readVector(handle, data, fileName);
+    fclose(handle);
+
+    kmerContainerStart.resize(kmers.size() + 1);
+    kmerContainerStart[0] = 0;
+    for (size_t i = 0; i < kmers.size(); ++i) {
+        kmerContainerStart[i + 1] = kmerContainerStart[i] + kmerContainerCount[i];
+    }
+    containerOffsets.resize(containers.size());
+    uint64_t offset = 0;
+    for (size_t c = 0; c < containers.size(); ++c) {
+        containerOffsets[c] = offset;
+        offset += getContainerWords((unsigned int) containers[c].cardinalityMinusOne + 1);
+    }
+    return kmers.empty() == false;
+}
@@ -0,0 +1,128 @@
+#ifndef SRASEARCH_HOTKMERPOSTINGS_H
+#define SRASEARCH_HOTKMERPOSTINGS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Roaring-style compressed ID sets of the hot k-mers of a merged k-mer table, stored in <tableName>_hot.
+ *
+ * The IDs of a k-mer are split into containers by the bits above the low 16 bits, so IDs of 40-bit
+ * tables fit as well. A container with up to ARRAY_MAX_SIZE IDs stores the low 16 bits as sorted array,
+ * denser containers as 2^16 bit bitmap. Hot k-mers are stored sorted and are not part of the regular
+ * k-mer/_ids stream of the table. Each k-mer costs 12 bytes and each container 6 bytes on top of the
+ * encoded IDs, so the encoding only pays off for k-mers with many IDs.
+ */
+class HotKmerPostings {
+public:
+    static const unsigned int ARRAY_MAX_SIZE = 4096;
+    static const unsigned int BITMAP_WORDS = 65536 / 64;
+    // first value of the file, _hot files with the older 32-bit container layout are rejected
+    static const uint64_t FORMAT_MAGIC = UINT64_C(0x32524d4b544f48);
+
+    HotKmerPostings() : kmerContainerStart(1, 0) {}
+
+    // ids have to be sorted and below 2^48, k-mers have to be added in ascending order
+    void add(unsigned long long kmer, const std::vector<uint64_t> &ids);
+
+    void write(const std::string &tableName) const;
+
+    // returns false if the table has no hot k-mers
+    bool read(const std::string &tableName);
+
+    size_t size() const {
+        return kmers.size();
+    }
+
+    unsigned long long getKmer(size_t i) const {
+        return kmers[i];
+    }
+
+    size_t getIdCount(size_t i) const;
+
+    // bytes used by the encoded sets
+    size_t getDataSize() const {
+        return data.size() * sizeof(uint64_t);
+    }
+
+    /**
+     * @brief Walks the IDs of one k-mer in ascending order and can be paused between IDs,
+     * so that the ID sets of several k-mers can be merged by ID
+     */
+    class IdIterator {
+    public:
+        IdIterator(const HotKmerPostings &postings, size_t i)
+            : postings(&postings), container(postings.kmerContainerStart[i]),
+              containerEnd(postings.kmerContainerStart[i + 1]), pos(0), id(0) {
+            findId();
+        }
+
+        bool atEnd() const {
+            return container >= containerEnd;
+        }
+
+        uint64_t getId() const {
+            return id;
+        }
+
+        void next() {
+            ++pos;
+            findId();
+        }
+
+    private:
+        const HotKmerPostings *postings;
+        size_t container;
+        size_t containerEnd;
+        // index into an array container or bit of a bitmap container
+        unsigned int pos;
+        uint64_t id;
+
+        // moves to the first ID at or after pos, continues with the following containers
+        void findId() {
+            for (; container < containerEnd; ++container, pos = 0) {
+                const Container &current = postings->containers[container];
+                const uint64_t high = ((uint64_t) current.high) << 16U;
+                const unsigned int cardinality = (unsigned int) current.cardinalityMinusOne + 1;
+                const uint64_t *words = postings->data.data() + postings->containerOffsets[container];
+                if (cardinality > ARRAY_MAX_SIZE) {
+                    for (unsigned int w = pos >> 6U; w < BITMAP_WORDS; ++w) {
+                        uint64_t word = words[w];
+                        if (w == pos >> 6U) {
+                            // bits below pos were visited already
+                            word = word >> (pos & 63U) << (pos & 63U);
+                        }
+                        if (word != 0) {
+                            pos = w * 64 + (unsigned int) __builtin_ctzll(word);
+                            id = high | pos;
+                            return;
+                        }
+                    }
+                } else if (pos < cardinality) {
+                    id = high | ((const uint16_t *) words)[pos];
+                    return;
+                }
+            }
+        }
+    };
+
+private:
+    struct __attribute__((__packed__)) Container {
+        uint32_t high;
+        uint16_t cardinalityMinusOne;
+    };
+
+    std::vector<unsigned long long> kmers;
+    std::vector<uint64_t> kmerContainerStart;
+    std::vector<Container> containers;
+    // offset of each container into data in 64-bit words, not stored in the file
+    std::vector<uint64_t> containerOffsets;
+    std::vector<uint64_t> data;
+
+    static size_t getContainerWords(unsigned int cardinality) {
+        return cardinality > ARRAY_MAX_SIZE ? BITMAP_WORDS : (cardinality + 3) / 4;
+    }
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef SRASEARCH_KMERINDEX_H
+#define SRASEARCH_KMERINDEX_H
+
+#include <cstddef>
+
+// Same result as Indexer::int2index(kmer, 0, K). The loop bound is a compile-time constant,
+// so the compiler fully unrolls it, benchmarkkmerindex measures the difference
+template <unsigned int K>
+static inline size_t kmerIndex(const unsigned char *kmer, const size_t *powers) {
+    // four independent sums like Indexer, a single one would chain all multiply-adds
+    size_t index[4] = {0, 0, 0, 0};
+    for (unsigned int i = 0; i < K; ++i) {
+        index[i % 4] += kmer[i] * powers[i];
+    }
+    return index[0] + index[1] + index[2] + index[3];
+}
+
+// Dispatches to the fixed size versions for the commonly used k-mer sizes 7 to 10
+static inline size_t kmerIndex(const unsigned char *kmer, const size_t *powers, unsigned int kmerSize) {
+    switch (kmerSize) {
+        case 7:
+            return kmerIndex<7>(kmer, powers);
+        case 8:
+            return kmerIndex<8>(kmer, powers);
+        case 9:
+            return kmerIndex<9>(kmer, powers);
+        case 10:
+            return kmerIndex<10>(kmer, powers);
+        default:
+            size_t index = 0;
+            for (unsigned int i = 0; i < kmerSize; ++i) {
+                index += kmer[i] * powers[i];
+            }
+            return index;
+    }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SRASEARCH_KMERSAMPLING_H
+#define SRASEARCH_KMERSAMPLING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Subsampling of the k-mers stored in a target table (--kmer-sampling)
+ * Minimizers keep the k-mer with the smallest hash of each window of consecutive k-mers (density ~2/(w+1)).
+ * They depend on the neighbouring k-mers, so the query side has to keep all of its k-mers.
+ * Open syncmers keep k-mers whose smallest s-mer (s = k - w + 1) is their first one (density ~1/w).
+ * This only depends on the k-mer itself, so query k-mers and their similar k-mers are filtered the same way.
+ */
+namespace KmerSampling {
+    enum {
+        NONE = 0,
+        MINIMIZER = 1,
+        SYNCMER = 2
+    };
+
+    // 64-bit finalizer of MurmurHash3, avoids selecting k-mers by their letter order
+    static inline uint64_t hash(uint64_t x) {
+        x ^= x >> 33U;
+        x *= UINT64_C(0xff51afd7ed558ccd);
+        x ^= x >> 33U;
+        x *= UINT64_C(0xc4ceb9fe1a85ec53);
+        x ^= x >> 33U;
+        return x;
+    }
+
+    // powers are the ones of the Indexer used to compute the k-mer index, window has to be in [1, kmerSize]
+    static inline bool isSyncmer(size_t kmer, const size_t *powers, unsigned int kmerSize, unsigned int window) {
+        if (window == 1) {
+            return true;
+        }
+        const unsigned int smerSize = kmerSize - window + 1;
+        const uint64_t firstHash = hash(kmer % powers[smerSize]);
+        for (unsigned int i = 1; i < window; ++i) {
+            // the s-mer starting at position i of the k-mer
+            if (hash((kmer / powers[i]) % powers[smerSize]) < firstHash) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // sets selected[i] for the smallest hash of each window of consecutive positions (leftmost on ties),
+    // positions with hash UINT64_MAX are never selected
+    static inline void selectMinimizers(const std::vector<uint64_t> &hashes, unsigned int window, std::vector<unsigned char> &selected) {
+        selected.assign(hashes.size(), 0);
+        if (hashes.empty()) {
+            return;
+        }
+        const size_t windowCount = hashes.size() > window ? hashes.size() - window + 1 : 1;
+        size_t minPos = SIZE_MAX;
+        for (size_t start = 0; start < windowCount; ++start) {
+            const size_t end = std::min(start + window, hashes.size());
+            if (minPos == SIZE_MAX || minPos < start) {
+                minPos = start;
+                for (size_t i = start + 1; i < end; ++i) {
+                    if (hashes[i] < hashes[minPos]) {
+                        minPos = i;
+                    }
+                }
+            } else if (hashes[end - 1] < hashes[minPos]) {
+                minPos = end - 1;
+            }
+            if (hashes[minPos] != UINT64_MAX) {
+                selected[minPos] = 1;
+            }
+        }
+    }
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define LOCALPARAMETERS_H
 
 #include "Parameters.h"
+#include "ByteParser.h"
 
 class LocalParameters : public Parameters {
 public:
@@ -25,6 +26,10 @@ public:
     std::vector<MMseqsParameter *> easypetasearchworkflow;
     std::vector<MMseqsParameter *> convertsraalignments;
     std::vector<MMseqsParameter *> readandprint;
+    std::vector<MMseqsParameter *> benchmarkkmergen;
+    std::vector<MMseqsParameter *> benchmarkkmerindex;
+    std::vector<MMseqsParameter *> benchmarkalignbackends;
+    std::vector<MMseqsParameter *> mergekmertables;
 
     PARAMETER(PARAM_REQ_KMER_MATCHES)
     unsigned int requiredKmerMatches;
@@ -38,9 +43,54 @@ public:
     PARAMETER(PARAM_RANGE_MAX)
     uintptr_t rangeMax;
 
+    PARAMETER(PARAM_ADAPTIVE_RANGE)
+    bool adaptiveRange;
+
     PARAMETER(PARAM_MAX_KMER_PER_POS)
     int maxKmerPerPos;
 
+    PARAMETER(PARAM_COMPRESS_QUERY_TABLE)
+    bool compressQueryTable;
+
+    PARAMETER(PARAM_SENSITIVITY_SWEEP)
+    std::string sensitivitySweep;
+
+    PARAMETER(PARAM_QUERY_DB_LIST)
+    std::string queryDbList;
+
+    PARAMETER(PARAM_TARGET_TABLES_PER_PASS)
+    int targetTablesPerPass;
+
+    PARAMETER(PARAM_MAX_KMER_MULTIPLICITY)
+    unsigned int maxKmerMultiplicity;
+
+    PARAMETER(PARAM_HOT_KMER_THRESHOLD)
+    unsigned int hotKmerThreshold;
+
+    PARAMETER(PARAM_MASK_TARGET)
+    int maskTarget;
+
+    PARAMETER(PARAM_KMER_SAMPLING)
+    int kmerSampling;
+
+    PARAMETER(PARAM_KMER_SAMPLING_WINDOW)
+    int kmerSamplingWindow;
+
+    PARAMETER(PARAM_CHAIN_MIN_SCORE)
+    int chainMinScore;
+
+    PARAMETER(PARAM_QUERY_CACHE_SIZE)
+    int queryCacheSize;
+
+    PARAMETER(PARAM_RESULT_MEMORY_LIMIT)
+    size_t resultMemoryLimit;
+
+    PARAMETER(PARAM_MAX_ALIGNED_SEQS)
+    int maxAlignedSeqs;
+
+    PARAMETER(PARAM_SW_MAX_LEN)
+    MultiParam<SeqProf<int>> swMaxLen;
+
 private:
     LocalParameters() : Parameters(),
         PARAM_REQ_KMER_MATCHES(
@@ -75,6 +125,14 @@ private:
             typeid(int),
             (void *) &rangeMax,
             "^[0-9]+$"),
+        PARAM_ADAPTIVE_RANGE(
+            PARAM_ADAPTIVE_RANGE_ID,
+            "--adaptive-range",
+            "Adaptive block-aligner matrix max size",
+            "Choose the maximum block size per pair from the residues not covered by the ungapped alignment, up to --range-max",
+            typeid(bool),
+            (void *) &adaptiveRange,
+            ""),
         PARAM_MAX_KMER_PER_POS(
             PARAM_MAX_KMER_PER_POS_ID,
             "--max-kmer-per-pos",
@@ -82,25 +140,150 @@ private:
             "Maximum k-mers per position [>=1]",
             typeid(int),
             (void *) &maxKmerPerPos,
-            "^[0-9]+$")
+            "^[0-9]+$"),
+        PARAM_COMPRESS_QUERY_TABLE(
+            PARAM_COMPRESS_QUERY_TABLE_ID,
+            "--compress-query-table",
+            "Compress query table",
+            "Keep the query table block compressed in memory during the join (slower join, 3-4x less memory)",
+            typeid(bool),
+            (void *) &compressQueryTable,
+            ""),
+        PARAM_SENSITIVITY_SWEEP(
+            PARAM_SENSITIVITY_SWEEP_ID,
+            "--sensitivity-sweep",
+            "Sensitivity sweep",
+            "Comma separated k-score:max-kmer-per-pos pairs, e.g. 200:40,175:80. Writes an additional result DB <resultDB>_<k-score>_<max-kmer-per-pos> for each pair in the same pass over the target tables",
+            typeid(std::string),
+            (void *) &sensitivitySweep,
+            "^([0-9]+:[0-9]+(,[0-9]+:[0-9]+)*)?$"),
+        PARAM_QUERY_DB_LIST(
+            PARAM_QUERY_DB_LIST_ID,
+            "--query-db-list",
+            "Query DB list",
+            "File listing additional query DBs (one per line) searched in the same pass over the target tables. Results of the i-th listed DB are written to <resultDB>_set<i>",
+            typeid(std::string),
+            (void *) &queryDbList,
+            ""),
+        PARAM_TARGET_TABLES_PER_PASS(
+            PARAM_TARGET_TABLES_PER_PASS_ID,
+            "--target-tables-per-pass",
+            "Target tables per pass",
+            "Number of target tables a thread joins in one pass over the query table [>=1]",
+            typeid(int),
+            (void *) &targetTablesPerPass,
+            "^[1-9][0-9]*$"),
+        PARAM_MAX_KMER_MULTIPLICITY(
+            PARAM_MAX_KMER_MULTIPLICITY_ID,
+            "--max-kmer-multiplicity",
+            "Maximum k-mer multiplicity",
+            "Skip k-mers occurring more often than this in the target DB, 0 keeps all k-mers. The multiplicity histogram is written to <kmerTable>_multiplicity",
+            typeid(int),
+            (void *) &maxKmerMultiplicity,
+            "^[0-9]+$"),
+        PARAM_HOT_KMER_THRESHOLD(
+            PARAM_HOT_KMER_THRESHOLD_ID,
+            "--hot-kmer-threshold",
+            "Hot k-mer threshold",
+            "k-mers with more IDs than this are stored as compressed ID sets in <mergedKmerTable>_hot, 0 disables the hot k-mer encoding",
+            typeid(int),
+            (void *) &hotKmerThreshold,
+            "^[0-9]+$"),
+        PARAM_MASK_TARGET(
+            PARAM_MASK_TARGET_ID,
+            "--mask-target",
+            "Mask target residues",
+            "Mask low-complexity regions of the target sequences with tantan before indexing: 0: w/o low complexity masking, 1: with low complexity masking",
+            typeid(int),
+            (void *) &maskTarget,
+            "^[0-1]{1}"),
+        PARAM_KMER_SAMPLING(
+            PARAM_KMER_SAMPLING_ID,
+            "--kmer-sampling",
+            "k-mer sampling",
+            "Index only a subset of the target k-mers: 0: all k-mers, 1: window minimizers, 2: open syncmers (query k-mers are filtered too)",
+            typeid(int),
+            (void *) &kmerSampling,
+            "^[0-2]{1}$"),
+        PARAM_KMER_SAMPLING_WINDOW(
+            PARAM_KMER_SAMPLING_WINDOW_ID,
+            "--kmer-sampling-window",
+            "k-mer sampling window",
+            "Minimizer window in k-mers, for syncmers the s-mer size is k - window + 1 [1, k]",
+            typeid(int),
+            (void *) &kmerSamplingWindow,
+            "^[1-9][0-9]*$"),
+        PARAM_CHAIN_MIN_SCORE(
+            PARAM_CHAIN_MIN_SCORE_ID,
+            "--chain-min-score",
+            "Minimum k-mer chain score",
+            "Align only pairs whose best co-linear chain of k-mer matches scores at least this much, each match adds up to k and a diagonal shift costs its length. 0: two k-mer matches within 4 diagonals",
+            typeid(int),
+            (void *) &chainMinScore,
+            "^[0-9]+$"),
+        PARAM_QUERY_CACHE_SIZE(
+            PARAM_QUERY_CACHE_SIZE_ID,
+            "--query-cache-size",
+            "Query cache size",
+            "Number of prepared queries (sequence, profile, consensus and block-aligner input) kept per thread [>=1]",
+            typeid(int),
+            (void *) &queryCacheSize,
+            "^[1-9][0-9]*$"),
+        PARAM_RESULT_MEMORY_LIMIT(
+            PARAM_RESULT_MEMORY_LIMIT_ID,
+            "--result-memory-limit",
+            "Result memory limit",
+            "Memory per thread for buffered results, beyond it they are spilled in sorted runs to <resultDB>_spill.<thread> and merged at the end. E.g. 800B, 5K, 10M, 1G. 0: keep all results in memory",
+            typeid(ByteParser),
+            (void *) &resultMemoryLimit,
+            "^(0|[1-9]{1}[0-9]*(B|K|M|G|T)?)$"),
+        PARAM_MAX_ALIGNED_SEQS(
+            PARAM_MAX_ALIGNED_SEQS_ID,
+            "--max-aligned-seqs",
+            "Max gapped alignments per query",
+            "Gap-align only the candidates of each query with the best ungapped scores, like --max-seqs of the prefilter. Ranking needs an additional pass over the targets. 0: align all candidates",
+            typeid(int),
+            (void *) &maxAlignedSeqs,
+            "^[0-9]+$"),
+        PARAM_SW_MAX_LEN(
+            PARAM_SW_MAX_LEN_ID,
+            "--sw-max-len",
+            "Max length for Smith-Waterman",
+            "Pairs whose longer sequence is at most this long are aligned with striped Smith-Waterman instead of block-aligner, for sequence and profile queries. benchmarkalignbackends measures the crossover. 0: always use block-aligner",
+            typeid(MultiParam<SeqProf<int>>),
+            (void *) &swMaxLen,
+            "^[0-9]{1}[0-9]*$")
     {
         createkmertable.push_back(&PARAM_SEED_SUB_MAT);
         createkmertable.push_back(&PARAM_K);
+        createkmertable.push_back(&PARAM_ALPH_SIZE);
         createkmertable.push_back(&PARAM_SPACED_KMER_MODE);
         createkmertable.push_back(&PARAM_SPACED_KMER_PATTERN);
         createkmertable.push_back(&PARAM_MAX_SEQ_LEN);
+        createkmertable.push_back(&PARAM_MAX_KMER_MULTIPLICITY);
+        createkmertable.push_back(&PARAM_MASK_TARGET);
+        createkmertable.push_back(&PARAM_MASK_PROBABILTY);
+        createkmertable.push_back(&PARAM_KMER_SAMPLING);
+        createkmertable.push_back(&PARAM_KMER_SAMPLING_WINDOW);
         createkmertable.push_back(&PARAM_THREADS);
         createkmertable.push_back(&PARAM_V);
 
         comparekmertables.push_back(&PARAM_EXACT_KMER_MATCHING);
         comparekmertables.push_back(&PARAM_SEED_SUB_MAT);
         comparekmertables.push_back(&PARAM_K);
+        comparekmertables.push_back(&PARAM_ALPH_SIZE);
         comparekmertables.push_back(&PARAM_K_SCORE);
         comparekmertables.push_back(&PARAM_SPACED_KMER_MODE);
         comparekmertables.push_back(&PARAM_SPACED_KMER_PATTERN);
         comparekmertables.push_back(&PARAM_MAX_SEQ_LEN);
         comparekmertables.push_back(&PARAM_REQ_KMER_MATCHES);
         comparekmertables.push_back(&PARAM_MAX_KMER_PER_POS);
+        comparekmertables.push_back(&PARAM_COMPRESS_QUERY_TABLE);
+        comparekmertables.push_back(&PARAM_SENSITIVITY_SWEEP);
+        comparekmertables.push_back(&PARAM_QUERY_DB_LIST);
+        comparekmertables.push_back(&PARAM_TARGET_TABLES_PER_PASS);
+        comparekmertables.push_back(&PARAM_KMER_SAMPLING);
+        comparekmertables.push_back(&PARAM_KMER_SAMPLING_WINDOW);
         comparekmertables.push_back(&PARAM_NO_COMP_BIAS_CORR);
         comparekmertables.push_back(&PARAM_MASK_RESIDUES);
         comparekmertables.push_back(&PARAM_MASK_PROBABILTY);
@@ -111,6 +294,8 @@ private:
         blockalign.push_back(&PARAM_E);
         blockalign.push_back(&PARAM_K);
         blockalign.push_back(&PARAM_SUB_MAT);
+        blockalign.push_back(&PARAM_SEED_SUB_MAT);
+        blockalign.push_back(&PARAM_ALPH_SIZE);
         blockalign.push_back(&PARAM_SPACED_KMER_MODE);
         blockalign.push_back(&PARAM_SPACED_KMER_PATTERN);
         blockalign.push_back(&PARAM_NO_COMP_BIAS_CORR);
@@ -119,7 +304,13 @@ private:
         blockalign.push_back(&PARAM_MAX_SEQ_LEN);
         blockalign.push_back(&PARAM_RANGE_MIN);
         blockalign.push_back(&PARAM_RANGE_MAX);
+        blockalign.push_back(&PARAM_ADAPTIVE_RANGE);
         blockalign.push_back(&PARAM_X_DROP);
+        blockalign.push_back(&PARAM_CHAIN_MIN_SCORE);
+        blockalign.push_back(&PARAM_QUERY_CACHE_SIZE);
+        blockalign.push_back(&PARAM_RESULT_MEMORY_LIMIT);
+        blockalign.push_back(&PARAM_MAX_ALIGNED_SEQS);
+        blockalign.push_back(&PARAM_SW_MAX_LEN);
         blockalign.push_back(&PARAM_ADD_BACKTRACE);
         blockalign.push_back(&PARAM_COMPRESSED);
         blockalign.push_back(&PARAM_THREADS);
@@ -133,6 +324,33 @@ private:
         convertsraalignments.push_back(&PARAM_THREADS);
         convertsraalignments = combineList(convertsraalignments, Parameters::convertalignments);
 
+        benchmarkkmergen.push_back(&PARAM_SEED_SUB_MAT);
+        benchmarkkmergen.push_back(&PARAM_K);
+        benchmarkkmergen.push_back(&PARAM_K_SCORE);
+        benchmarkkmergen.push_back(&PARAM_MAX_SEQ_LEN);
+        benchmarkkmergen.push_back(&PARAM_MAX_KMER_PER_POS);
+        benchmarkkmergen.push_back(&PARAM_THREADS);
+        benchmarkkmergen.push_back(&PARAM_V);
+
+        benchmarkkmerindex.push_back(&PARAM_SEED_SUB_MAT);
+        benchmarkkmerindex.push_back(&PARAM_K);
+        benchmarkkmerindex.push_back(&PARAM_MAX_SEQ_LEN);
+        benchmarkkmerindex.push_back(&PARAM_V);
+
+        benchmarkalignbackends.push_back(&PARAM_E);
+        benchmarkalignbackends.push_back(&PARAM_SUB_MAT);
+        benchmarkalignbackends.push_back(&PARAM_GAP_OPEN);
+        benchmarkalignbackends.push_back(&PARAM_GAP_EXTEND);
+        benchmarkalignbackends.push_back(&PARAM_MAX_SEQ_LEN);
+        benchmarkalignbackends.push_back(&PARAM_RANGE_MIN);
+        benchmarkalignbackends.push_back(&PARAM_RANGE_MAX);
+        benchmarkalignbackends.push_back(&PARAM_ADAPTIVE_RANGE);
+        benchmarkalignbackends.push_back(&PARAM_X_DROP);
+        benchmarkalignbackends.push_back(&PARAM_V);
+
+        mergekmertables.push_back(&PARAM_HOT_KMER_THRESHOLD);
+        mergekmertables.push_back(&PARAM_V);
+
         petasearchworkflow = combineList(createkmertable, comparekmertables);
         petasearchworkflow = combineList(petasearchworkflow, blockalign);
         petasearchworkflow = combineList(petasearchworkflow, swapresult);
@@ -144,12 +362,28 @@ private:
         requiredKmerMatches = 2;
         xdrop = 10;
         rangeMin = 32;
-        rangeMax = 32;
+        rangeMax = 256;
+        adaptiveRange = false;
 
         kmerSize = 9;
         kmerScore = 225;
 
         maxKmerPerPos = 20;
+        compressQueryTable = false;
+        sensitivitySweep = "";
+        queryDbList = "";
+        targetTablesPerPass = 1;
+        maxKmerMultiplicity = 0;
+        hotKmerThreshold = 0;
+        maskTarget = 0;
+        kmerSampling = 0;
+        kmerSamplingWindow = 5;
+        chainMinScore = 0;
+        queryCacheSize = 1024;
+        resultMemoryLimit = 1024 * 1024 * 1024;
+        maxAlignedSeqs = 0;
+        // block-aligner was faster at all lengths in benchmarkalignbackends
+        swMaxLen = MultiParam<SeqProf<int>>(SeqProf<int>(0, 0));
 
         rescoreMode = Parameters::RESCORE_MODE_ALIGNMENT;
     }
@@ -0,0 +1,76 @@
+#ifndef SRASEARCH_QUERYDATACACHE_H
+#define SRASEARCH_QUERYDATACACHE_H
+
+#include "BlockAligner.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Bounded per-thread cache of prepared query data, least recently used entries are evicted first
+ * The same queries are aligned against many targets, this avoids decompressing their entries,
+ * extracting the consensus of profiles and loading them into block-aligner again for every pair.
+ */
+class QueryDataCache {
+public:
+    struct Entry {
+        unsigned int key;
+        unsigned int seqLen;
+        // sequence, or consensus sequence of a profile
+        std::string seq;
+        // profile entry, empty for sequences
+        std::string profile;
+        // block-aligner input, loaded on the first gapped alignment. Reused entries keep the buffers
+        // of their previous key, so they are only valid if the key matches.
+        BlockAligner::Target aligned;
+    };
+
+    explicit QueryDataCache(size_t capacity) : capacity(capacity > 0 ? capacity : 1), hits(0), lookups(0) {}
+
+    // returns NULL if the key is not cached
+    Entry *get(unsigned int key) {
+        lookups++;
+        std::unordered_map<unsigned int, std::list<Entry>::iterator>::iterator it = index.find(key);
+        if (it == index.end()) {
+            return NULL;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return &entries.front();
+    }
+
+    // returns an entry for key that has to be filled by the caller, the least recently used one is reused if the cache is full
+    Entry *insert(unsigned int key) {
+        if (entries.size() < capacity) {
+            entries.emplace_front();
+        } else {
+            index.erase(entries.back().key);
+            entries.splice(entries.begin(), entries, std::prev(entries.end()));
+        }
+        Entry &entry = entries.front();
+        entry.key = key;
+        entry.seqLen = 0;
+        entry.seq.clear();
+        entry.profile.clear();
+        index[key] = entries.begin();
+        return &entry;
+    }
+
+    size_t getHits() const {
+        return hits;
+    }
+
+    size_t getLookups() const {
+        return lookups;
+    }
+
+private:
+    const size_t capacity;
+    std::list<Entry> entries;
+    std::unordered_map<unsigned int, std::list<Entry>::iterator> index;
+    size_t hits;
+    size_t lookups;
+};
+
+#endif
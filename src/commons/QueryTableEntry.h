@@ -5,8 +5,14 @@
 #include "Util.h"
 #include "itoa.h"
 
+#include <climits>
+#include <cstdint>
+
 struct __attribute__((__packed__)) QueryTableEntry
 {
+    // targetSequenceID of query entries that have not been joined with a target table yet
+    static const unsigned int NO_TARGET_ID = UINT_MAX;
+
     unsigned int querySequenceId;
     unsigned int targetSequenceID;
     union {
@@ -21,7 +27,8 @@ struct __attribute__((__packed__)) QueryTableEntry
         } Result;
     };
 
-    static size_t queryEntryToBuffer(char *buff1, QueryTableEntry &h) {
+    template <typename Entry>
+    static size_t queryEntryToBuffer(char *buff1, const Entry &h) {
         char * basePos = buff1;
         char * tmpBuff = Itoa::u32toa_sse2((uint32_t) h.querySequenceId, buff1);
         *(tmpBuff-1) = '\t';
@@ -49,4 +56,72 @@ struct __attribute__((__packed__)) QueryTableEntry
     }
 };
 
+/**
+ * @brief Query table entry for joins with merged tables with 5-byte IDs (more than 2^32 IDs in total)
+ * Only used by comparekmertables if such a table is part of the target tables, the IDs are relative to
+ * the source table again once the hits are written.
+ */
+struct __attribute__((__packed__)) WideQueryTableEntry
+{
+    static const uint64_t TARGET_ID_BITS = 40;
+    static const uint64_t NO_TARGET_ID = (UINT64_C(1) << TARGET_ID_BITS) - 1;
+
+    unsigned int querySequenceId;
+    uint64_t targetSequenceID : TARGET_ID_BITS;
+    union {
+        struct __attribute__((__packed__)) {
+            unsigned int kmerPosInQuery;
+            unsigned long long kmer;
+        } Query;
+        struct __attribute__((__packed__)) {
+            unsigned int diag;
+            unsigned int score;
+            unsigned int eval;
+        } Result;
+    };
+};
+
+/**
+ * @brief Query table entry of a sensitivity sweep, only used when comparekmertables got --sensitivity-sweep
+ * Score and rank select the settings of the sweep that generated the k-mer, so that plain query tables
+ * keep the entry size of Base. Base is QueryTableEntry or WideQueryTableEntry.
+ */
+template <typename Base>
+struct __attribute__((__packed__)) ScoredQueryTableEntry : public Base
+{
+    // generation score (after bias correction) and rank of a similar k-mer
+    short kmerScore;
+    unsigned short kmerRank;
+};
+
+// entries without a score are accepted by every setting, like the exact k-mer
+template <typename Entry>
+inline short getKmerScore(const Entry &) {
+    return SHRT_MAX;
+}
+
+template <typename Base>
+inline short getKmerScore(const ScoredQueryTableEntry<Base> &entry) {
+    return entry.kmerScore;
+}
+
+template <typename Entry>
+inline unsigned short getKmerRank(const Entry &) {
+    return 0;
+}
+
+template <typename Base>
+inline unsigned short getKmerRank(const ScoredQueryTableEntry<Base> &entry) {
+    return entry.kmerRank;
+}
+
+template <typename Entry>
+inline void setKmerScore(Entry &, short, unsigned short) {}
+
+template <typename Base>
+inline void setKmerScore(ScoredQueryTableEntry<Base> &entry, short score, unsigned short rank) {
+    entry.kmerScore = score;
+    entry.kmerRank = rank;
+}
+
 #endif
\ No newline at end of file
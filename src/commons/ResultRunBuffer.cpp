@@ -0,0 +1,200 @@
+#include "ResultRunBuffer.h"
+#include "Debug.h"
+#include "FileUtil.h"
+#include "FastSort.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+ResultRunBuffer::ResultRunBuffer(const std::string &spillFileName, size_t memoryLimit, Compare compare)
+    : spillFileName(spillFileName), memoryLimit(memoryLimit), compare(compare), backtraceMemory(0),
+      spillFile(NULL), spillSize(0), memoryPos(0), readBufferSize(0) {}
+
+ResultRunBuffer::~ResultRunBuffer() {
+    if (spillFile != NULL) {
+        fclose(spillFile);
+    }
+    if (runs.empty() == false) {
+        FileUtil::remove(spillFileName.c_str());
+    }
+}
+
+void ResultRunBuffer::add(Matcher::result_t &res) {
+    results.emplace_back();
+    std::swap(results.back(), res);
+    backtraceMemory += results.back().backtrace.capacity();
+    // the vector capacity is counted, it can be up to twice its size after growing
+    if (memoryLimit > 0 && results.capacity() * sizeof(Matcher::result_t) + backtraceMemory > memoryLimit) {
+        spill();
+    }
+}
+
+void ResultRunBuffer::spill() {
+    if (spillFile == NULL) {
+        spillFile = FileUtil::openFileOrDie(spillFileName.c_str(), "w+b", false);
+    }
+    SORT_SERIAL(results.begin(), results.end(), compare);
+    Run run;
+    run.begin = spillSize;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Matcher::result_t &res = results[i];
+        Record record;
+        record.dbKey = res.dbKey;
+        record.score = res.score;
+        record.qcov = res.qcov;
+        record.dbcov = res.dbcov;
+        record.seqId = res.seqId;
+        record.eval = res.eval;
+        record.alnLength = res.alnLength;
+        record.qStartPos = res.qStartPos;
+        record.qEndPos = res.qEndPos;
+        record.qLen = res.qLen;
+        record.dbStartPos = res.dbStartPos;
+        record.dbEndPos = res.dbEndPos;
+        record.dbLen = res.dbLen;
+        record.queryOrfStartPos = res.queryOrfStartPos;
+        record.queryOrfEndPos = res.queryOrfEndPos;
+        record.dbOrfStartPos = res.dbOrfStartPos;
+        record.dbOrfEndPos = res.dbOrfEndPos;
+        record.backtraceLen = (unsigned int) res.backtrace.size();
+        if (fwrite(&record, sizeof(Record), 1, spillFile) != 1
+            || fwrite(res.backtrace.data(), sizeof(char), res.backtrace.size(), spillFile) != res.backtrace.size()) {
+            Debug(Debug::ERROR) << "Cannot write to spill file " << spillFileName << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+        spillSize += sizeof(Record) + res.backtrace.size();
+    }
+    run.end = spillSize;
+    run.offset = run.begin;
+    run.bufferPos = 0;
+    runs.emplace_back(run);
+    // drop the capacity too, the buffer would otherwise keep its peak size
+    std::vector<Matcher::result_t>().swap(results);
+    backtraceMemory = 0;
+}
+
+// makes sure that the buffer of run holds at least size unread bytes, returns false at the end of the run
+bool ResultRunBuffer::fillBuffer(Run &run, size_t size) {
+    const size_t available = run.buffer.size() - run.bufferPos;
+    if (available >= size) {
+        return true;
+    }
+    if (available + (run.end - run.offset) < size) {
+        return false;
+    }
+    if (run.bufferPos > 0) {
+        memmove(run.buffer.data(), run.buffer.data() + run.bufferPos, available);
+        run.bufferPos = 0;
+    }
+    // a long backtrace may need more than the usual read size
+    const size_t toRead = std::min(std::max(readBufferSize, size) - available, run.end - run.offset);
+    run.buffer.resize(available + toRead);
+    const int fd = fileno(spillFile);
+    size_t done = 0;
+    while (done < toRead) {
+        const ssize_t got = pread(fd, run.buffer.data() + available + done, toRead - done, run.offset + done);
+        if (got <= 0) {
+            Debug(Debug::ERROR) << "Cannot read spill file " << spillFileName << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+        done += got;
+    }
+    run.offset += toRead;
+    return true;
+}
+
+bool ResultRunBuffer::readRecord(Run &run, Matcher::result_t &res) {
+    if (fillBuffer(run, sizeof(Record)) == false) {
+        return false;
+    }
+    Record record;
+    memcpy(&record, run.buffer.data() + run.bufferPos, sizeof(Record));
+    run.bufferPos += sizeof(Record);
+    res.dbKey = record.dbKey;
+    res.score = record.score;
+    res.qcov = record.qcov;
+    res.dbcov = record.dbcov;
+    res.seqId = record.seqId;
+    res.eval = record.eval;
+    res.alnLength = record.alnLength;
+    res.qStartPos = record.qStartPos;
+    res.qEndPos = record.qEndPos;
+    res.qLen = record.qLen;
+    res.dbStartPos = record.dbStartPos;
+    res.dbEndPos = record.dbEndPos;
+    res.dbLen = record.dbLen;
+    res.queryOrfStartPos = record.queryOrfStartPos;
+    res.queryOrfEndPos = record.queryOrfEndPos;
+    res.dbOrfStartPos = record.dbOrfStartPos;
+    res.dbOrfEndPos = record.dbOrfEndPos;
+    if (fillBuffer(run, record.backtraceLen) == false) {
+        Debug(Debug::ERROR) << "Truncated record in spill file " << spillFileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    res.backtrace.assign(run.buffer.data() + run.bufferPos, record.backtraceLen);
+    run.bufferPos += record.backtraceLen;
+    return true;
+}
+
+void ResultRunBuffer::finish() {
+    if (runs.empty()) {
+        SORT_SERIAL(results.begin(), results.end(), compare);
+        memoryPos = 0;
+        return;
+    }
+    if (results.empty() == false) {
+        spill();
+    }
+    // the runs are read with pread on the descriptor of the spill file, which bypasses the FILE buffer
+    if (fflush(spillFile) != 0) {
+        Debug(Debug::ERROR) << "Cannot write to spill file " << spillFileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    // the read buffers of all runs share the memory limit
+    const size_t maxReadBufferSize = 64 * 1024;
+    readBufferSize = std::max(sizeof(Record), std::min(maxReadBufferSize, memoryLimit / runs.size()));
+    heads.resize(runs.size());
+    heap.clear();
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (readRecord(runs[i], heads[i])) {
+            heap.emplace_back(i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), [this](size_t first, size_t second) {
+        return headAfter(first, second);
+    });
+}
+
+// max-heap order, the smallest head comes first and ties go to the earlier run
+bool ResultRunBuffer::headAfter(size_t first, size_t second) const {
+    return compare(heads[second], heads[first])
+           || (compare(heads[first], heads[second]) == false && second < first);
+}
+
+bool ResultRunBuffer::next(Matcher::result_t &res) {
+    if (runs.empty()) {
+        if (memoryPos >= results.size()) {
+            return false;
+        }
+        std::swap(res, results[memoryPos++]);
+        return true;
+    }
+    if (heap.empty()) {
+        return false;
+    }
+    auto heapCompare = [this](size_t first, size_t second) {
+        return headAfter(first, second);
+    };
+    std::pop_heap(heap.begin(), heap.end(), heapCompare);
+    const size_t run = heap.back();
+    std::swap(res, heads[run]);
+    if (readRecord(runs[run], heads[run])) {
+        std::push_heap(heap.begin(), heap.end(), heapCompare);
+    } else {
+        heap.pop_back();
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef SRASEARCH_RESULTRUNBUFFER_H
+#define SRASEARCH_RESULTRUNBUFFER_H
+
+#include "Matcher.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Sorted result buffer of one thread with bounded memory
+ * Backtraces are kept as compressed CIGAR strings (e.g. 12M1I30M) and handed out in that form.
+ * Once the buffered results exceed the memory limit they are sorted and appended as a run to a spill file,
+ * finish() then merges the runs and the remaining results in sort order. A memory limit of 0 never spills.
+ * All runs are read through the one descriptor of the spill file, each with a small read buffer,
+ * so the number of open files does not grow with the number of runs.
+ */
+class ResultRunBuffer {
+public:
+    typedef bool (*Compare)(const Matcher::result_t &first, const Matcher::result_t &second);
+
+    ResultRunBuffer(const std::string &spillFileName, size_t memoryLimit, Compare compare);
+    ~ResultRunBuffer();
+
+    // takes over the result, its backtrace has to be compressed already
+    void add(Matcher::result_t &res);
+
+    // call once after the last add, then read the results in sort order with next()
+    void finish();
+    bool next(Matcher::result_t &res);
+
+    size_t getRunCount() const {
+        return runs.size();
+    }
+
+private:
+    struct Run {
+        size_t begin;
+        size_t end;
+        // file offset of the next byte that is not in buffer yet
+        size_t offset;
+        std::vector<char> buffer;
+        size_t bufferPos;
+    };
+
+    // fixed size part of a spilled result, followed by the compressed backtrace
+    struct Record {
+        unsigned int dbKey;
+        int score;
+        float qcov;
+        float dbcov;
+        float seqId;
+        double eval;
+        unsigned int alnLength;
+        int qStartPos;
+        int qEndPos;
+        unsigned int qLen;
+        int dbStartPos;
+        int dbEndPos;
+        unsigned int dbLen;
+        int queryOrfStartPos;
+        int queryOrfEndPos;
+        int dbOrfStartPos;
+        int dbOrfEndPos;
+        unsigned int backtraceLen;
+    };
+
+    const std::string spillFileName;
+    const size_t memoryLimit;
+    const Compare compare;
+
+    std::vector<Matcher::result_t> results;
+    size_t backtraceMemory;
+
+    FILE *spillFile;
+    size_t spillSize;
+    std::vector<Run> runs;
+
+    // merge state, heads[i] is the current result of run i and heap holds the runs that still have one
+    size_t memoryPos;
+    std::vector<Matcher::result_t> heads;
+    std::vector<size_t> heap;
+    size_t readBufferSize;
+
+    void spill();
+    bool fillBuffer(Run &run, size_t size);
+    bool readRecord(Run &run, Matcher::result_t &res);
+    bool headAfter(size_t first, size_t second) const;
+};
+
+#endif
@@ -264,6 +264,32 @@ char *SRADBReader::getData(size_t id, int thread_idx) {
     return seqBuffer[thread_idx];
 }
 
+// asks the kernel to read the packed entry of id in the background, the next getData does not fault on it then
+void SRADBReader::prefetch(size_t id) {
+#ifdef HAVE_POSIX_MADVISE
+    if (dataMapped == false || id >= size) {
+        return;
+    }
+    const size_t offset = index[id];
+    // a broken index is reported by the getData call that follows
+    if (offset >= totalDataSize) {
+        return;
+    }
+    size_t cnt = 0;
+    while (!(offset >= dataSizeOffset[cnt] && offset < dataSizeOffset[cnt + 1])) {
+        cnt++;
+    }
+    const size_t end = std::min(id < size - 1 ? index[id + 1] : totalDataSize, dataSizeOffset[cnt + 1]);
+    // madvise needs a page aligned start, the data files are mapped at page boundaries
+    const size_t fileOffset = offset - dataSizeOffset[cnt];
+    const size_t alignedOffset = fileOffset - fileOffset % Util::getPageSize();
+    const size_t length = end - dataSizeOffset[cnt] - alignedOffset;
+    if (length > 0 && posix_madvise(dataFiles[cnt] + alignedOffset, length, POSIX_MADV_WILLNEED) != 0) {
+        Debug(Debug::WARNING) << "posix_madvise returned an error " << dataFileName << "\n";
+    }
+#endif
+}
+
 char *SRADBReader::getDataUncompressed(size_t id) {
     checkClosed();
     if (!(dataMode & DBReader<unsigned int>::USE_DATA)) {
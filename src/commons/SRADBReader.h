@@ -27,6 +27,7 @@ public:
     size_t getSeqLen(size_t id);
     unsigned int getDbKey(size_t id);
     char *getData(size_t id, int thread_idx);
+    void prefetch(size_t id);
     size_t getAminoAcidDBSize();
     void readIndex(char *data, size_t indexDataSize, unsigned long *index);
     unsigned long* getIndex() {
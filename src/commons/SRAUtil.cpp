@@ -4,6 +4,10 @@
 #include "FileUtil.h"
 #include "BaseMatrix.h"
 #include "Sequence.h"
+#include "SubstitutionMatrix.h"
+#include "NucleotideMatrix.h"
+#include "ReducedMatrix.h"
+#include "KmerSampling.h"
 
 #include <cstring>
 #include <cstdlib>
@@ -66,4 +70,62 @@ namespace SRAUtil {
         }
         return result;
     }
+
+    BaseMatrix *getKmerMatrix(const Parameters &par, bool nucleotide, float bitFactor, float scoreBias) {
+        if (nucleotide) {
+            return new NucleotideMatrix(par.seedScoringMatrixFile.values.nucleotide().c_str(), 1.0, 0.0);
+        }
+        const int alphabetSize = par.alphabetSize.values.aminoacid();
+        if (alphabetSize < 21) {
+            SubstitutionMatrix sMat(par.seedScoringMatrixFile.values.aminoacid().c_str(), bitFactor, scoreBias);
+            return new ReducedMatrix(sMat.probMatrix, sMat.subMatrixPseudoCounts, sMat.aa2num, sMat.num2aa,
+                                     sMat.alphabetSize, alphabetSize, bitFactor);
+        }
+        return new SubstitutionMatrix(par.seedScoringMatrixFile.values.aminoacid().c_str(), bitFactor, scoreBias);
+    }
+
+    std::string getKmerParameters(const LocalParameters &par) {
+        std::string parameters;
+        parameters.append("kmerSize\t").append(SSTR(par.kmerSize)).append("\n");
+        parameters.append("alphabetSize\t").append(SSTR(par.alphabetSize.values.aminoacid())).append("\n");
+        parameters.append("spacedKmer\t").append(SSTR(par.spacedKmer)).append("\n");
+        parameters.append("spacedKmerPattern\t").append(par.spacedKmer ? par.spacedKmerPattern : "").append("\n");
+        // only listed when used, so tables of all k-mers keep their parameter files
+        if (par.kmerSampling != KmerSampling::NONE) {
+            parameters.append("kmerSampling\t").append(SSTR(par.kmerSampling)).append("\n");
+            parameters.append("kmerSamplingWindow\t").append(SSTR(par.kmerSamplingWindow)).append("\n");
+        }
+        return parameters;
+    }
+
+    void writeKmerParameters(const std::string &kmerTable, const std::string &kmerParameters) {
+        const std::string fileName = kmerTable + "_kmerparams";
+        FILE *handle = fopen(fileName.c_str(), "w");
+        if (handle == NULL
+            || fwrite(kmerParameters.c_str(), sizeof(char), kmerParameters.size(), handle) != kmerParameters.size()
+            || fclose(handle) != 0) {
+            Debug(Debug::ERROR) << "Cannot write " << fileName << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+
+    void checkKmerParameters(const std::string &kmerTable, const std::string &kmerParameters) {
+        const std::string fileName = kmerTable + "_kmerparams";
+        if (FileUtil::fileExists(fileName.c_str()) == false) {
+            return;
+        }
+        std::string tableParameters;
+        char buffer[1024];
+        FILE *handle = FileUtil::openFileOrDie(fileName.c_str(), "r", true);
+        size_t count;
+        while ((count = fread(buffer, sizeof(char), sizeof(buffer), handle)) > 0) {
+            tableParameters.append(buffer, count);
+        }
+        fclose(handle);
+        if (tableParameters != kmerParameters) {
+            Debug(Debug::ERROR) << "k-mer table " << kmerTable << " was created with different k-mer parameters:\n"
+                                << tableParameters << "Expected:\n" << kmerParameters;
+            EXIT(EXIT_FAILURE);
+        }
+    }
 }
@@ -1,6 +1,7 @@
 // Created by matchy on 2/1/22.
 #ifndef SRASEARCH_SRAUTIL_H
 #include "BaseMatrix.h"
+#include "LocalParameters.h"
 
 #include <string>
 #include <vector>
@@ -40,6 +41,26 @@ namespace SRAUtil {
 
     std::string extractProfileSequence(const char *seqData, size_t seqLen, BaseMatrix *subMat);
 
+/**
+ * @brief Matrix that maps residues to k-mer letters
+ * The seed matrix, reduced to --alph-size letters (ReducedMatrix) for amino acids if below 21.
+ */
+    BaseMatrix *getKmerMatrix(const Parameters &par, bool nucleotide, float bitFactor, float scoreBias);
+
+/**
+ * @brief Describes how k-mers are extracted: k-mer size, alphabet size, spaced pattern and k-mer sampling
+ * Stored in <kmerTable>_kmerparams by createkmertable and compared against by comparekmertables.
+ */
+    std::string getKmerParameters(const LocalParameters &par);
+
+    void writeKmerParameters(const std::string &kmerTable, const std::string &kmerParameters);
+
+/**
+ * @brief Exits if the k-mer table was created with different k-mer parameters
+ * Tables without a _kmerparams file are accepted as they are.
+ */
+    void checkKmerParameters(const std::string &kmerTable, const std::string &kmerParameters);
+
 }
 #define SRASEARCH_SRAUTIL_H
 
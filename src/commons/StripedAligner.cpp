@@ -0,0 +1,164 @@
+#include "StripedAligner.h"
+#include "EvalueComputation.h"
+#include "Matcher.h"
+#include "Parameters.h"
+
+#include <cfloat>
+
+StripedAligner::StripedAligner(size_t maxSequenceLength, int8_t gapOpen, int8_t gapExtend, BaseMatrix &subMat, int dbtype)
+    : aligner(maxSequenceLength, subMat.alphabetSize, false, 1.0, Parameters::DBTYPE_AMINO_ACIDS),
+      subMat(subMat),
+      profileTarget(Parameters::isEqualDbtype(dbtype, Parameters::DBTYPE_HMM_PROFILE)),
+      // block-aligner profiles charge the extension on top of the gap open
+      gapOpen((uint8_t) (profileTarget ? -gapOpen - gapExtend : -gapOpen)),
+      gapExtend((uint8_t) -gapExtend),
+      aKey(NO_KEY),
+      aSeq(NULL),
+      aLen(0),
+      aMapped(false),
+      aSequence(maxSequenceLength, Parameters::DBTYPE_AMINO_ACIDS, &subMat, 0, false, false, false),
+      bSequence(maxSequenceLength, dbtype, &subMat, 0, false, false, false) {
+    tinySubMat = new int8_t[subMat.alphabetSize * subMat.alphabetSize];
+    for (int i = 0; i < subMat.alphabetSize; i++) {
+        for (int j = 0; j < subMat.alphabetSize; j++) {
+            tinySubMat[i * subMat.alphabetSize + j] = subMat.subMatrix[i][j];
+        }
+    }
+    profileMat = NULL;
+    if (profileTarget) {
+        profileMat = new int8_t[(maxSequenceLength + 1) * subMat.alphabetSize];
+    }
+    // a backtrace has at most one run per column
+    sAlnCigar = new uint32_t[2 * maxSequenceLength + 1];
+}
+
+StripedAligner::~StripedAligner() {
+    delete[] tinySubMat;
+    delete[] profileMat;
+    delete[] sAlnCigar;
+}
+
+void StripedAligner::setQuery(unsigned int queryKey, const char *querySeq, unsigned int queryLength) {
+    if (queryKey == NO_KEY || queryKey != aKey) {
+        aMapped = false;
+    }
+    aKey = queryKey;
+    aSeq = querySeq;
+    aLen = queryLength;
+}
+
+s_align StripedAligner::alignTarget(
+    unsigned int targetKey,
+    const char *targetSeq,
+    unsigned int targetLength,
+    std::string &backtrace,
+    EvalueComputation *evaluer,
+    double evalThr
+) {
+    if (aMapped == false) {
+        aSequence.mapSequence(0, aKey, aSeq, aLen);
+        if (profileTarget == false) {
+            aligner.ssw_init(&aSequence, tinySubMat, &subMat);
+        }
+        aMapped = true;
+    }
+    bSequence.mapSequence(0, targetKey, targetSeq, targetLength);
+
+    // striped Smith-Waterman builds its profile from its query, which has to be the profile if there is one
+    std::string swBacktrace;
+    s_align sw;
+    if (profileTarget) {
+        const int aa = Sequence::PROFILE_READIN_SIZE;
+        const int8_t *profile = reinterpret_cast<const int8_t *>(targetSeq);
+        for (int i = 0; i < bSequence.L; ++i) {
+            for (size_t j = 0; j < Sequence::PROFILE_AA_SIZE; ++j) {
+                profileMat[j * bSequence.L + i] = profile[i * aa + j] >> 2;
+            }
+        }
+        aligner.ssw_init(&bSequence, profileMat, &subMat);
+        sw = aligner.ssw_align(
+            aSequence.numSequence, aSequence.numConsensusSequence, aSequence.getAlignmentProfile(), aLen, swBacktrace,
+            gapOpen, gapExtend, Matcher::SCORE_COV_SEQID, DBL_MAX, evaluer, Parameters::COV_MODE_BIDIRECTIONAL, 0.0f, 0.0f, 0, targetKey
+        );
+    } else {
+        sw = aligner.ssw_align(
+            bSequence.numSequence, bSequence.numConsensusSequence, bSequence.getAlignmentProfile(), targetLength, swBacktrace,
+            gapOpen, gapExtend, Matcher::SCORE_COV_SEQID, evalThr, evaluer, Parameters::COV_MODE_BIDIRECTIONAL, 0.0f, 0.0f, 0, targetKey
+        );
+    }
+    delete[] sw.cigar;
+
+    s_align r;
+    r.score2 = 0;
+    r.ref_end2 = -1;
+    r.cigar = sAlnCigar;
+    r.cigarLen = 0;
+    r.identicalAACnt = 0;
+    if (sw.dbEndPos1 == -1) {
+        // no residue could be aligned
+        r.score1 = 0;
+        r.qStartPos1 = r.qEndPos1 = r.dbStartPos1 = r.dbEndPos1 = 0;
+        r.qCov = r.tCov = 0.0f;
+        r.evalue = evaluer->computeEvalue(0, aLen);
+        return r;
+    }
+    // Smith-Waterman end positions are inclusive
+    if (profileTarget) {
+        r.qStartPos1 = sw.dbStartPos1;
+        r.qEndPos1 = sw.dbEndPos1 + 1;
+        r.dbStartPos1 = sw.qStartPos1;
+        r.dbEndPos1 = sw.qEndPos1 + 1;
+    } else {
+        r.qStartPos1 = sw.qStartPos1;
+        r.qEndPos1 = sw.qEndPos1 + 1;
+        r.dbStartPos1 = sw.dbStartPos1;
+        r.dbEndPos1 = sw.dbEndPos1 + 1;
+    }
+    if (r.qStartPos1 == -1 || r.dbStartPos1 == -1) {
+        // rejected by the E-value before the start positions were computed
+        r.qStartPos1 = 0;
+        r.dbStartPos1 = 0;
+    }
+    r.score1 = static_cast<int>(evaluer->computeBitScore(sw.score1) + 0.5);
+    r.evalue = evaluer->computeEvalue(sw.score1, aLen);
+    r.qCov = SmithWaterman::computeCov(r.qStartPos1, r.qEndPos1, aLen);
+    r.tCov = SmithWaterman::computeCov(r.dbStartPos1, r.dbEndPos1, targetLength);
+    if (swBacktrace.empty()) {
+        // rejected by the E-value before the traceback
+        return r;
+    }
+
+    // runs of the backtrace in the orientation of BlockAligner, for sequences matches and mismatches are separate runs
+    int aPos = r.qStartPos1;
+    int bPos = r.dbStartPos1;
+    char lastOp = '\0';
+    uint32_t runLength = 0;
+    for (size_t i = 0; i < swBacktrace.size(); ++i) {
+        char state = swBacktrace[i];
+        if (profileTarget && state != 'M') {
+            state = state == 'I' ? 'D' : 'I';
+        }
+        char op = state;
+        if (state == 'M') {
+            if (profileTarget == false) {
+                op = aSeq[aPos] == targetSeq[bPos] ? '=' : 'X';
+                r.identicalAACnt += (op == '=');
+            }
+            aPos++;
+            bPos++;
+        } else if (state == 'I') {
+            aPos++;
+        } else {
+            bPos++;
+        }
+        backtrace.push_back(state);
+        if (op != lastOp && runLength > 0) {
+            sAlnCigar[r.cigarLen++] = (runLength << 4U) | (lastOp == 'I' ? 1U : (lastOp == 'D' ? 2U : 0U));
+            runLength = 0;
+        }
+        lastOp = op;
+        runLength++;
+    }
+    sAlnCigar[r.cigarLen++] = (runLength << 4U) | (lastOp == 'I' ? 1U : (lastOp == 'D' ? 2U : 0U));
+    return r;
+}
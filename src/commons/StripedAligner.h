@@ -0,0 +1,61 @@
+#ifndef SRASEARCH_STRIPEDALIGNER_H
+#define SRASEARCH_STRIPEDALIGNER_H
+
+#include "StripedSmithWaterman.h"
+#include "Sequence.h"
+
+#include <climits>
+#include <string>
+
+class EvalueComputation;
+
+/**
+ * @brief Striped Smith-Waterman backend with the target-major interface of BlockAligner
+ * Results follow the conventions of BlockAligner::alignTarget: the query side (a) set by setQuery gives qStartPos1,
+ * qEndPos1 and qCov and is the length of the E-value, end positions are exclusive, score1 is the bit score, cigarLen
+ * counts the runs of the backtrace ('I' consumes a, 'D' consumes b), with matches and mismatches as separate runs
+ * for sequences. Profile scores are divided by 4 and rounded down as in BlockAligner.
+ * Unlike BlockAligner, the alignment is the optimal local one and not an x-drop extension of the seed.
+ * For sequences the profile of a is built once per query side, profiles of the target side (b) are built per pair.
+ */
+class StripedAligner {
+public:
+    StripedAligner(size_t maxSequenceLength, int8_t gapOpen, int8_t gapExtend, BaseMatrix &subMat, int dbtype);
+    ~StripedAligner();
+
+    static const unsigned int NO_KEY = UINT_MAX;
+
+    void setQuery(unsigned int queryKey, const char *querySeq, unsigned int queryLength);
+
+    // like BlockAligner, pairs whose E-value is above evalThr return without traceback (cigarLen 0)
+    s_align alignTarget(
+        unsigned int targetKey,
+        const char *targetSeq,
+        unsigned int targetLength,
+        std::string &backtrace,
+        EvalueComputation *evaluer,
+        double evalThr
+    );
+
+private:
+    SmithWaterman aligner;
+    BaseMatrix &subMat;
+    int8_t *tinySubMat;
+    // alignment profile of b, scaled down like in BlockAligner
+    int8_t *profileMat;
+    bool profileTarget;
+    uint8_t gapOpen;
+    uint8_t gapExtend;
+
+    unsigned int aKey;
+    const char *aSeq;
+    unsigned int aLen;
+    // the a side was mapped (and for sequences, the query profile built) for aKey
+    bool aMapped;
+
+    Sequence aSequence;
+    Sequence bSequence;
+    uint32_t *sAlnCigar;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "TargetTableReader.h"
+#include "Debug.h"
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <cstdlib> // aligned_alloc
+#include <fcntl.h>  // open, read
+#include <unistd.h>
+
+TargetTableReader::TargetTableReader(const std::string &tableName, size_t maxBlocks)
+    : tableName(tableName), kmerBlockIdx(0), kmerReadGroup(0), idBlockIdx(0), idReadGroup(0),
+      kmer(0), id(0) {
+    idBytes = readIdBytes(tableName);
+    idBlockBytes = idBytes == 4 ? MEM_SIZE_32MB : MEM_SIZE_40MB;
+    fdKmerTable = openDirect(tableName);
+    fdIDTable = openDirect(tableName + "_ids");
+
+    kmerTableSize = FileUtil::getFileSize(tableName);
+    idTableSize = FileUtil::getFileSize(tableName + "_ids");
+
+    maxBlocks = std::max(maxBlocks, (size_t) 1);
+    const size_t numOfKmerBlocks = std::min(maxBlocks, countBlocks(kmerTableSize, MEM_SIZE_16MB));
+    const size_t numOfIDBlocks = std::min(maxBlocks, countBlocks(idTableSize, idBlockBytes));
+    kmerBlocks.resize(numOfKmerBlocks, nullptr);
+    kmerBlockSize.resize(numOfKmerBlocks, -1);
+    idBlocks.resize(numOfIDBlocks, nullptr);
+    idBlockSize.resize(numOfIDBlocks, -1);
+    // TODO: determine the alignment dynamically instead of using hard-coded 512
+    for (size_t i = 0; i < kmerBlocks.size(); ++i) {
+        kmerBlocks[i] = aligned_alloc(512, MEM_SIZE_16MB);
+        if (kmerBlocks[i] == nullptr) {
+            Debug(Debug::ERROR) << "Cannot allocate memory for target table\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+    for (size_t i = 0; i < idBlocks.size(); ++i) {
+        idBlocks[i] = aligned_alloc(512, idBlockBytes);
+        if (idBlocks[i] == nullptr) {
+            Debug(Debug::ERROR) << "Cannot allocate memory for ID table\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+
+    kmerPos = kmerEnd = nullptr;
+    idPos = idEnd = nullptr;
+    if (kmerBlocks.empty() == false) {
+        readBlocks(fdKmerTable, kmerBlocks, kmerBlockSize, MEM_SIZE_16MB, 0);
+        kmerPos = (const unsigned short *) kmerBlocks[0];
+        kmerEnd = kmerPos + std::max(kmerBlockSize[0], (ssize_t) 0) / sizeof(unsigned short);
+    }
+    if (idBlocks.empty() == false) {
+        readBlocks(fdIDTable, idBlocks, idBlockSize, idBlockBytes, 0);
+        idPos = (const unsigned char *) idBlocks[0];
+        idEnd = idPos + std::max(idBlockSize[0], (ssize_t) 0) / idBytes * idBytes;
+    }
+}
+
+TargetTableReader::~TargetTableReader() {
+    for (size_t i = 0; i < kmerBlocks.size(); ++i) {
+        free(kmerBlocks[i]);
+    }
+    for (size_t i = 0; i < idBlocks.size(); ++i) {
+        free(idBlocks[i]);
+    }
+    if (close(fdIDTable) < 0) {
+        Debug(Debug::ERROR) << "Cannot close ID table " << tableName << "_ids\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (close(fdKmerTable) < 0) {
+        Debug(Debug::ERROR) << "Cannot close target table " << tableName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+int TargetTableReader::openDirect(const std::string &fileName) {
+#if !defined(O_DIRECT)
+    const int mode = (O_RDONLY | O_SYNC);
+#else
+    const int mode = (O_RDONLY | O_DIRECT | O_SYNC);
+#endif
+    int fd = open(fileName.c_str(), mode);
+    if (fd < 0) {
+        Debug(Debug::ERROR) << "Open table " << fileName << " failed\n";
+        EXIT(EXIT_FAILURE);
+    }
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+    fcntl(fd, F_NOCACHE, 1);
+#endif
+    return fd;
+}
+
+void TargetTableReader::readBlocks(
+    int fd, std::vector<void *> &destBlocks, std::vector<ssize_t> &destBlockSize, size_t blockSize, size_t offsetBlock
+) {
+    const size_t end = destBlocks.size();
+    for (size_t j = 0; j < end; j++) {
+        off_t offset = (off_t) ((offsetBlock * end + j) * blockSize);
+        if ((destBlockSize[j] = pread(fd, destBlocks[j], blockSize, offset)) < 0) {
+            Debug(Debug::ERROR) << "Cannot read chunk #" << (offsetBlock * end + j + 1) << " from table\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+}
+
+bool TargetTableReader::fetchKmerBlock() {
+    if (kmerBlocks.empty()) {
+        return false;
+    }
+    ++kmerBlockIdx;
+    if (kmerBlockIdx >= kmerBlocks.size()) {
+        ++kmerReadGroup;
+        if (kmerReadGroup * kmerBlocks.size() * MEM_SIZE_16MB >= kmerTableSize) {
+            return false;
+        }
+        readBlocks(fdKmerTable, kmerBlocks, kmerBlockSize, MEM_SIZE_16MB, kmerReadGroup);
+        kmerBlockIdx = 0;
+    }
+    if (kmerBlockSize[kmerBlockIdx] <= 0) {
+        return false;
+    }
+    kmerPos = (const unsigned short *) kmerBlocks[kmerBlockIdx];
+    kmerEnd = kmerPos + kmerBlockSize[kmerBlockIdx] / sizeof(unsigned short);
+    return true;
+}
+
+bool TargetTableReader::fetchIDBlock() {
+    if (idBlocks.empty()) {
+        return false;
+    }
+    ++idBlockIdx;
+    if (idBlockIdx >= idBlocks.size()) {
+        ++idReadGroup;
+        if (idReadGroup * idBlocks.size() * idBlockBytes >= idTableSize) {
+            return false;
+        }
+        readBlocks(fdIDTable, idBlocks, idBlockSize, idBlockBytes, idReadGroup);
+        idBlockIdx = 0;
+    }
+    if (idBlockSize[idBlockIdx] <= 0) {
+        return false;
+    }
+    idPos = (const unsigned char *) idBlocks[idBlockIdx];
+    idEnd = idPos + idBlockSize[idBlockIdx] / idBytes * idBytes;
+    return true;
+}
+
+std::vector<uint64_t> TargetTableReader::readInfo(const std::string &tableName) {
+    std::vector<uint64_t> idOffsets;
+    const std::string infoFileName = tableName + "_info";
+    if (FileUtil::fileExists(infoFileName.c_str()) == false) {
+        return idOffsets;
+    }
+    char *line = nullptr;
+    size_t len = 0;
+    FILE *handle = FileUtil::openFileOrDie(infoFileName.c_str(), "r", true);
+    while (getline(&line, &len, handle) != -1) {
+        // header lines start with #
+        if (line[0] != '#') {
+            idOffsets.emplace_back(Util::fast_atoi<unsigned long long>(line));
+        }
+    }
+    fclose(handle);
+    free(line);
+    return idOffsets;
+}
+
+unsigned int TargetTableReader::readIdBytes(const std::string &tableName) {
+    const std::string infoFileName = tableName + "_info";
+    if (FileUtil::fileExists(infoFileName.c_str()) == false) {
+        return 4;
+    }
+    unsigned int idBytes = 4;
+    char *line = nullptr;
+    size_t len = 0;
+    FILE *handle = FileUtil::openFileOrDie(infoFileName.c_str(), "r", true);
+    while (getline(&line, &len, handle) != -1 && line[0] == '#') {
+        if (strncmp(line, "#idBytes\t", 9) == 0) {
+            idBytes = Util::fast_atoi<unsigned int>(line + 9);
+        }
+    }
+    fclose(handle);
+    free(line);
+    if (idBytes != 4 && idBytes != 5) {
+        Debug(Debug::ERROR) << "Unsupported ID size of " << idBytes << " bytes in " << infoFileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    return idBytes;
+}
@@ -0,0 +1,128 @@
+#ifndef SRASEARCH_TARGETTABLEREADER_H
+#define SRASEARCH_TARGETTABLEREADER_H
+
+#include "BitManipulateMacros.h"
+#include "Util.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#define MEM_SIZE_16MB ((size_t) (16 * 1024 * 1024))
+#define MEM_SIZE_32MB ((size_t) (32 * 1024 * 1024))
+#define MEM_SIZE_40MB ((size_t) (40 * 1024 * 1024))
+
+/**
+ * @brief Sequential reader for a k-mer table written by createkmertable.
+ *
+ * The k-mer table (diff encoded in 15-bit chunks) is read in 16MB blocks, the ID table in 32MB blocks
+ * (40MB for 5-byte IDs, so that no ID crosses a block boundary).
+ * Both files are opened with O_DIRECT and up to maxBlocks blocks are read at once.
+ */
+class TargetTableReader {
+public:
+    TargetTableReader(const std::string &tableName, size_t maxBlocks);
+
+    ~TargetTableReader();
+
+    // advance to the next (k-mer, id) entry, returns false once the table is exhausted
+    inline bool next() {
+        if (UNLIKELY(kmerPos >= kmerEnd) && fetchKmerBlock() == false) {
+            return false;
+        }
+        uint64_t diff = 0;
+        while (UNLIKELY(!IS_LAST_15_BITS(*kmerPos))) {
+            diff = DECODE_15_BITS(diff, *kmerPos);
+            diff <<= 15U;
+            ++kmerPos;
+            if (UNLIKELY(kmerPos >= kmerEnd) && fetchKmerBlock() == false) {
+                return false;
+            }
+        }
+        diff = DECODE_15_BITS(diff, *kmerPos);
+        ++kmerPos;
+        kmer += diff;
+
+        if (UNLIKELY(idPos >= idEnd) && fetchIDBlock() == false) {
+            return false;
+        }
+        id = readId(idPos, idBytes);
+        idPos += idBytes;
+        return true;
+    }
+
+    unsigned long long getKmer() const {
+        return kmer;
+    }
+
+    uint64_t getId() const {
+        return id;
+    }
+
+    unsigned int getIdBytes() const {
+        return idBytes;
+    }
+
+    size_t getDataSize() const {
+        return kmerTableSize + idTableSize;
+    }
+
+    // ID offsets of the source tables of a table written by mergekmertables, empty for other tables
+    static std::vector<uint64_t> readInfo(const std::string &tableName);
+
+    // bytes per entry of the ID table: 4, or 5 if the _info header of a merged table says so
+    static unsigned int readIdBytes(const std::string &tableName);
+
+    // IDs are stored little endian, 5-byte IDs as the 4-byte ID of the low bits followed by the high byte
+    static inline uint64_t readId(const unsigned char *data, unsigned int idBytes) {
+        uint32_t low;
+        memcpy(&low, data, sizeof(uint32_t));
+        if (idBytes == 4) {
+            return low;
+        }
+        return low | ((uint64_t) data[4] << 32U);
+    }
+
+    static size_t countBlocks(size_t fileSize, size_t blockSize) {
+        return fileSize / blockSize + (fileSize % blockSize == 0 ? 0 : 1);
+    }
+
+private:
+    std::string tableName;
+
+    int fdKmerTable;
+    int fdIDTable;
+    size_t kmerTableSize;
+    size_t idTableSize;
+
+    std::vector<void *> kmerBlocks;
+    std::vector<ssize_t> kmerBlockSize;
+    size_t kmerBlockIdx;
+    size_t kmerReadGroup;
+
+    std::vector<void *> idBlocks;
+    std::vector<ssize_t> idBlockSize;
+    size_t idBlockIdx;
+    size_t idReadGroup;
+
+    const unsigned short *kmerPos;
+    const unsigned short *kmerEnd;
+    const unsigned char *idPos;
+    const unsigned char *idEnd;
+    unsigned int idBytes;
+    size_t idBlockBytes;
+
+    unsigned long long kmer;
+    uint64_t id;
+
+    bool fetchKmerBlock();
+    bool fetchIDBlock();
+
+    static int openDirect(const std::string &fileName);
+    static void readBlocks(int fd, std::vector<void *> &destBlocks, std::vector<ssize_t> &destBlockSize,
+                           size_t blockSize, size_t offsetBlock);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "TargetTableWriter.h"
+#include "Debug.h"
+#include "Util.h"
+
+#define KMER_BUFSIZ (8 * 1024 * 1024)
+#define ID_BUFSIZ (4 * 1024 * 1024)
+
+TargetTableWriter::TargetTableWriter(const std::string &tableName, unsigned int idBytes)
+    : tableName(tableName), kmerBuf(KMER_BUFSIZ), kmerBufIdx(0), idBytes(idBytes), idBuf(ID_BUFSIZ * idBytes), idBufIdx(0),
+      lastKmer(0), entryCount(0) {
+    handleKmerTable = fopen(tableName.c_str(), "wb");
+    if (handleKmerTable == NULL) {
+        Debug(Debug::ERROR) << "Cannot open target table " << tableName << " for writing\n";
+        EXIT(EXIT_FAILURE);
+    }
+    handleIDTable = fopen((tableName + "_ids").c_str(), "wb");
+    if (handleIDTable == NULL) {
+        Debug(Debug::ERROR) << "Cannot open ID table " << tableName << "_ids for writing\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+TargetTableWriter::~TargetTableWriter() {
+    close();
+}
+
+void TargetTableWriter::close() {
+    if (handleKmerTable == NULL) {
+        return;
+    }
+    flushKmerBuf();
+    flushIDBuf();
+    if (fclose(handleKmerTable) != 0 || fclose(handleIDTable) != 0) {
+        Debug(Debug::ERROR) << "Cannot close target table " << tableName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    handleKmerTable = NULL;
+    handleIDTable = NULL;
+}
+
+void TargetTableWriter::flushKmerBuf() {
+    if (fwrite(kmerBuf.data(), sizeof(uint16_t), kmerBufIdx, handleKmerTable) != kmerBufIdx) {
+        Debug(Debug::ERROR) << "Cannot write target table " << tableName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    kmerBufIdx = 0;
+}
+
+void TargetTableWriter::flushIDBuf() {
+    if (fwrite(idBuf.data(), sizeof(unsigned char), idBufIdx, handleIDTable) != idBufIdx) {
+        Debug(Debug::ERROR) << "Cannot write ID table " << tableName << "_ids\n";
+        EXIT(EXIT_FAILURE);
+    }
+    idBufIdx = 0;
+}
+
+void TargetTableWriter::writeInfo(const std::string &tableName, const std::vector<std::string> &sourceTables,
+                                  const std::vector<uint64_t> &idOffsets, unsigned int idBytes) {
+    const std::string infoFileName = tableName + "_info";
+    FILE *handle = fopen(infoFileName.c_str(), "w");
+    if (handle == NULL) {
+        Debug(Debug::ERROR) << "Cannot open " << infoFileName << " for writing\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (idBytes != 4) {
+        fprintf(handle, "#idBytes\t%u\n", idBytes);
+    }
+    for (size_t i = 0; i < sourceTables.size(); ++i) {
+        fprintf(handle, "%llu\t%s\n", (unsigned long long) idOffsets[i], sourceTables[i].c_str());
+    }
+    if (fclose(handle) != 0) {
+        Debug(Debug::ERROR) << "Cannot close " << infoFileName << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
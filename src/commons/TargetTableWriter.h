@@ -0,0 +1,92 @@
+#ifndef SRASEARCH_TARGETTABLEWRITER_H
+#define SRASEARCH_TARGETTABLEWRITER_H
+
+#include "BitManipulateMacros.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Sequential writer for the k-mer table format read by TargetTableReader.
+ *
+ * Entries have to be added sorted by k-mer. The k-mer is stored as the difference to the previous k-mer
+ * in 15-bit chunks (the last chunk carries the end flag), the ID with idBytes (4 or 5) bytes in <tableName>_ids.
+ * 5-byte IDs are only used by merged tables and have to be announced in <tableName>_info (see writeInfo).
+ */
+class TargetTableWriter {
+public:
+    explicit TargetTableWriter(const std::string &tableName, unsigned int idBytes = 4);
+
+    ~TargetTableWriter();
+
+    inline void writeEntry(unsigned long long kmer, uint64_t id) {
+        uint64_t kmerdiff = kmer - lastKmer;
+        lastKmer = kmer;
+        // Consecutively store 15 bits of information into a short, until kmer diff is all
+        uint16_t buffer[5]; // 15*5 = 75 > 64
+        buffer[4] = SET_END_FLAG(GET_15_BITS(kmerdiff));
+        kmerdiff >>= 15U;
+        int idx = 3;
+        while (kmerdiff) {
+            buffer[idx] = GET_15_BITS(kmerdiff);
+            kmerdiff >>= 15U;
+            idx--;
+        }
+        const size_t size = 4 - idx;
+        if (kmerBufIdx + size > kmerBuf.size()) {
+            flushKmerBuf();
+        }
+        memcpy(kmerBuf.data() + kmerBufIdx, buffer + idx + 1, sizeof(uint16_t) * size);
+        kmerBufIdx += size;
+
+        if (idBufIdx + idBytes > idBuf.size()) {
+            flushIDBuf();
+        }
+        // same layout as TargetTableReader::readId
+        const uint32_t low = (uint32_t) id;
+        memcpy(idBuf.data() + idBufIdx, &low, sizeof(uint32_t));
+        if (idBytes == 5) {
+            idBuf[idBufIdx + 4] = (unsigned char) (id >> 32U);
+        }
+        idBufIdx += idBytes;
+        ++entryCount;
+    }
+
+    // flushes the buffers and closes both files, called by the destructor if needed
+    void close();
+
+    size_t getEntryCount() const {
+        return entryCount;
+    }
+
+    /**
+     * @brief Writes <tableName>_info for a table merged from several source tables
+     * Line j holds the ID offset and the name of source table j: the entries of source table j have the IDs
+     * [offset_j, offset_j+1) in the merged table, the original ID is the stored ID minus offset_j.
+     * Tables with 5-byte IDs start with the header line "#idBytes\t5".
+     */
+    static void writeInfo(const std::string &tableName, const std::vector<std::string> &sourceTables,
+                          const std::vector<uint64_t> &idOffsets, unsigned int idBytes);
+
+private:
+    std::string tableName;
+    FILE *handleKmerTable;
+    FILE *handleIDTable;
+
+    std::vector<uint16_t> kmerBuf;
+    size_t kmerBufIdx;
+    unsigned int idBytes;
+    std::vector<unsigned char> idBuf;
+    size_t idBufIdx;
+
+    unsigned long long lastKmer;
+    size_t entryCount;
+
+    void flushKmerBuf();
+    void flushIDBuf();
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "LocalParameters.h"
+#include "Debug.h"
+#include "DBReader.h"
+#include "Sequence.h"
+#include "SubstitutionMatrix.h"
+#include "EvalueComputation.h"
+#include "BlockAligner.h"
+#include "StripedAligner.h"
+#include "Timer.h"
+
+#include <random>
+
+// pairs per length, taken from the first entries that are long enough
+const size_t BENCHMARK_PAIRS_PER_LENGTH = 200;
+
+struct BenchmarkPair {
+    // sequence or profile entry
+    std::string target;
+    std::string targetConsensus;
+    std::string query;
+    BlockAligner::LocalAln seed;
+};
+
+// homolog of a sequence with about 30% substitutions and an indel every 50 residues
+static void mutateSequence(const std::string &seq, std::minstd_rand &rng, std::string &result) {
+    const char residues[] = "ACDEFGHIKLMNPQRSTVWY";
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> residue(0, 19);
+    result.clear();
+    for (size_t i = 0; i < seq.size(); ++i) {
+        const int event = percent(rng);
+        if (event == 0) {
+            // deletion
+            continue;
+        }
+        if (event == 1) {
+            result.push_back(residues[residue(rng)]);
+        }
+        result.push_back(percent(rng) < 30 ? residues[residue(rng)] : seq[i]);
+    }
+}
+
+// Measures the gapped alignment time per pair of block-aligner and striped Smith-Waterman for increasing sequence
+// lengths, the crossover is the default of --sw-max-len. Pairs are windows of the entries (the target side, as the
+// queries in blockalign) and a mutated copy of their sequence or profile consensus (the query side).
+int benchmarkalignbackends(int argc, const char **argv, const Command &command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    const int seqType = FileUtil::parseDbType(par.db1.c_str());
+    const bool useProfileSearch = Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_HMM_PROFILE);
+    if (Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_AMINO_ACIDS) == false && useProfileSearch == false) {
+        Debug(Debug::ERROR) << "Invalid input type (Support: amino acid, profile)\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    DBReader<unsigned int> reader(
+        par.db1.c_str(), par.db1Index.c_str(), 1, DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA
+    );
+    reader.open(DBReader<unsigned int>::LINEAR_ACCCESS);
+    reader.readMmapedDataInMemory();
+
+    SubstitutionMatrix subMat(par.scoringMatrixFile.values.aminoacid().c_str(), 2.0, 0.0);
+    EvalueComputation evaluer(reader.getAminoAcidDBSize(), &subMat);
+    const int8_t gapOpen = -par.gapOpen.values.aminoacid();
+    const int8_t gapExtend = -par.gapExtend.values.aminoacid();
+    BlockAligner blockAligner(par.maxSeqLen, par.rangeMin, par.rangeMax, gapOpen, gapExtend, subMat, seqType, par.adaptiveRange);
+    StripedAligner stripedAligner(par.maxSeqLen, gapOpen, gapExtend, subMat, seqType);
+
+    std::minstd_rand rng(42);
+    std::string backtrace;
+    size_t crossover = 0;
+    bool stripedFaster = true;
+    Debug(Debug::INFO) << "Length\tPairs\tBlock-aligner us/pair\tSmith-Waterman us/pair\tSame score\tHigher SW score\n";
+    for (size_t length = 16; length <= par.maxSeqLen; length *= 2) {
+        std::vector<BenchmarkPair> pairs;
+        for (size_t i = 0; i < reader.getSize() && pairs.size() < BENCHMARK_PAIRS_PER_LENGTH; ++i) {
+            if (reader.getSeqLen(i) < length) {
+                continue;
+            }
+            pairs.emplace_back();
+            BenchmarkPair &pair = pairs.back();
+            const char *data = reader.getData(i, 0);
+            if (useProfileSearch) {
+                Sequence::extractProfileConsensus(data, reader.getEntryLen(i) - 1, subMat, pair.targetConsensus);
+                pair.targetConsensus.resize(length);
+                pair.target.assign(data, length * Sequence::PROFILE_READIN_SIZE);
+            } else {
+                pair.targetConsensus.assign(data, length);
+                pair.target = pair.targetConsensus;
+            }
+            mutateSequence(pair.targetConsensus, rng, pair.query);
+            pair.seed = blockAligner.ungappedAlign(
+                pair.query.c_str(), NULL, pair.query.size(), pair.targetConsensus.c_str(), NULL, length, 0
+            );
+            // like the invalid diagonals in blockalign
+            if (pair.seed.a_end > pair.query.size() || pair.seed.b_end > length) {
+                pairs.pop_back();
+            }
+        }
+        if (pairs.empty()) {
+            break;
+        }
+        std::vector<int> blockScores(pairs.size());
+        std::vector<int> stripedScores(pairs.size());
+
+        Timer blockTimer;
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            backtrace.clear();
+            blockAligner.setQuery(BlockAligner::NO_KEY, pairs[i].query.c_str(), pairs[i].query.size());
+            s_align aln = blockAligner.alignTarget(
+                BlockAligner::NO_KEY, pairs[i].target.c_str(), length, pairs[i].seed, backtrace, &evaluer, par.xdrop, par.evalThr
+            );
+            blockScores[i] = aln.score1;
+        }
+        const double blockSeconds = blockTimer.getTimediff();
+
+        Timer stripedTimer;
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            backtrace.clear();
+            stripedAligner.setQuery(StripedAligner::NO_KEY, pairs[i].query.c_str(), pairs[i].query.size());
+            s_align aln = stripedAligner.alignTarget(
+                StripedAligner::NO_KEY, pairs[i].target.c_str(), length, backtrace, &evaluer, par.evalThr
+            );
+            stripedScores[i] = aln.score1;
+        }
+        const double stripedSeconds = stripedTimer.getTimediff();
+
+        size_t sameScore = 0;
+        size_t higherScore = 0;
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            sameScore += stripedScores[i] == blockScores[i];
+            higherScore += stripedScores[i] > blockScores[i];
+        }
+        Debug(Debug::INFO) << length << "\t" << pairs.size()
+                           << "\t" << 1e6 * blockSeconds / pairs.size()
+                           << "\t" << 1e6 * stripedSeconds / pairs.size()
+                           << "\t" << sameScore << "\t" << higherScore << "\n";
+        if (stripedFaster && stripedSeconds < blockSeconds) {
+            crossover = length;
+        } else {
+            stripedFaster = false;
+        }
+    }
+    Debug(Debug::INFO) << "Smith-Waterman is faster up to length: " << crossover << "\n";
+
+    reader.close();
+    return EXIT_SUCCESS;
+}
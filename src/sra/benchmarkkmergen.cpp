@@ -0,0 +1,93 @@
+#include "LocalParameters.h"
+#include "Debug.h"
+#include "DBReader.h"
+#include "Sequence.h"
+#include "SubstitutionMatrix.h"
+#include "ExtendedSubstitutionMatrix.h"
+#include "FixedKmerGenerator.h"
+#include "Timer.h"
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// Measures the throughput of the similar k-mer generation of createQueryTable in isolation
+int benchmarkkmergen(int argc, const char **argv, const Command &command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.spacedKmer = false;
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    const int seqType = FileUtil::parseDbType(par.db1.c_str());
+    const bool useProfileSearch = Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_HMM_PROFILE);
+    if (Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_AMINO_ACIDS) == false && useProfileSearch == false) {
+        Debug(Debug::ERROR) << "Invalid input type (Support: amino acid, profile)\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    DBReader<unsigned int> reader(
+        par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA
+    );
+    reader.open(DBReader<unsigned int>::LINEAR_ACCCESS);
+    reader.readMmapedDataInMemory();
+
+    SubstitutionMatrix subMat(
+        par.seedScoringMatrixFile.values.aminoacid().c_str(), useProfileSearch ? 2.0f : 8.0f, useProfileSearch ? 0.0f : -0.2f
+    );
+    ScoreMatrix twoMatrix, threeMatrix;
+    if (!useProfileSearch) {
+        twoMatrix = ExtendedSubstitutionMatrix::calcScoreMatrix(subMat, 2);
+        threeMatrix = ExtendedSubstitutionMatrix::calcScoreMatrix(subMat, 3);
+    }
+
+    const unsigned int kmerSize = par.kmerSize;
+    const int kmerThr = useProfileSearch ? par.kmerScore.values.profile() : par.kmerScore.values.sequence();
+    size_t totalPositions = 0;
+    size_t totalKmers = 0;
+
+    Timer timer;
+#pragma omp parallel default(none) shared(par, reader, subMat, seqType, twoMatrix, threeMatrix) firstprivate(kmerSize, kmerThr, useProfileSearch) reduction(+:totalPositions, totalKmers)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = (unsigned int) omp_get_thread_num();
+#endif
+        Sequence sequence(par.maxSeqLen, seqType, &subMat, kmerSize, par.spacedKmer, false, useProfileSearch ? false : true, par.spacedKmerPattern);
+        FixedKmerGenerator kmerGenerator(kmerSize, subMat.alphabetSize - 1, kmerThr, par.maxKmerPerPos);
+        if (useProfileSearch) {
+            kmerGenerator.setDivideStrategy(sequence.profile_matrix);
+        } else {
+            kmerGenerator.setDivideStrategy(&threeMatrix, &twoMatrix);
+        }
+
+#pragma omp for schedule(dynamic, 1) nowait
+        for (size_t i = 0; i < reader.getSize(); ++i) {
+            unsigned int key = reader.getDbKey(i);
+            char *data = reader.getData(i, (int) thread_idx);
+            unsigned int seqLen = reader.getSeqLen(i);
+            sequence.mapSequence(i, key, data, seqLen);
+            while (sequence.hasNextKmer()) {
+                const unsigned char *kmer = sequence.nextKmer();
+                if (sequence.kmerContainsX()) {
+                    continue;
+                }
+                totalKmers += kmerGenerator.generateKmerList(kmer).second;
+                totalPositions++;
+            }
+        }
+    }
+    const double seconds = std::max(timer.getTimediff(), 1e-9);
+
+    Debug(Debug::INFO) << "Positions: " << totalPositions
+                       << "\nGenerated k-mers: " << totalKmers
+                       << "\nk-mers per pos: " << (double) totalKmers / (double) std::max(totalPositions, (size_t) 1)
+                       << "\nTime: " << seconds << " s"
+                       << "\nPositions per second: " << (double) totalPositions / seconds
+                       << "\nk-mers per second: " << (double) totalKmers / seconds << "\n";
+
+    if (!useProfileSearch) {
+        ExtendedSubstitutionMatrix::freeScoreMatrix(twoMatrix);
+        ExtendedSubstitutionMatrix::freeScoreMatrix(threeMatrix);
+    }
+    reader.close();
+    return EXIT_SUCCESS;
+}
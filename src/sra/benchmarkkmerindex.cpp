@@ -0,0 +1,80 @@
+#include "LocalParameters.h"
+#include "Debug.h"
+#include "DBReader.h"
+#include "Sequence.h"
+#include "SubstitutionMatrix.h"
+#include "Indexer.h"
+#include "KmerIndex.h"
+#include "Timer.h"
+
+// Measures the k-mer index computation of Indexer::int2index against kmerIndex for the chosen k-mer size
+int benchmarkkmerindex(int argc, const char **argv, const Command &command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.spacedKmer = false;
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    const int seqType = FileUtil::parseDbType(par.db1.c_str());
+    if (Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_AMINO_ACIDS) == false) {
+        Debug(Debug::ERROR) << "Invalid input type (Support: amino acid)\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    DBReader<unsigned int> reader(
+        par.db1.c_str(), par.db1Index.c_str(), 1, DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA
+    );
+    reader.open(DBReader<unsigned int>::LINEAR_ACCCESS);
+
+    SubstitutionMatrix subMat(par.seedScoringMatrixFile.values.aminoacid().c_str(), 8.0f, -0.2f);
+    const unsigned int kmerSize = par.kmerSize;
+    Sequence sequence(par.maxSeqLen, seqType, &subMat, kmerSize, par.spacedKmer, false, true, par.spacedKmerPattern);
+    Indexer idx(subMat.alphabetSize - 1, kmerSize);
+
+    // all k-mers are copied out first, so that only the index computation is timed
+    std::vector<unsigned char> kmers;
+    for (size_t i = 0; i < reader.getSize(); ++i) {
+        sequence.mapSequence(i, reader.getDbKey(i), reader.getData(i, 0), reader.getSeqLen(i));
+        while (sequence.hasNextKmer()) {
+            const unsigned char *kmer = sequence.nextKmer();
+            kmers.insert(kmers.end(), kmer, kmer + kmerSize);
+        }
+    }
+    reader.close();
+    const size_t kmerCount = kmers.size() / kmerSize;
+    if (kmerCount == 0) {
+        Debug(Debug::ERROR) << "No k-mers of size " << kmerSize << " in " << par.db1 << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    // repeat the input until at least 100M indices are computed
+    const size_t passes = std::max((size_t) 1, (size_t) 100000000 / kmerCount);
+
+    size_t indexerSum = 0;
+    Timer timer;
+    for (size_t pass = 0; pass < passes; ++pass) {
+        for (size_t i = 0; i < kmerCount; ++i) {
+            indexerSum += idx.int2index(kmers.data() + i * kmerSize, 0, kmerSize);
+        }
+    }
+    const double indexerSeconds = std::max(timer.getTimediff(), 1e-9);
+
+    size_t kmerIndexSum = 0;
+    timer.reset();
+    for (size_t pass = 0; pass < passes; ++pass) {
+        for (size_t i = 0; i < kmerCount; ++i) {
+            kmerIndexSum += kmerIndex(kmers.data() + i * kmerSize, idx.powers, kmerSize);
+        }
+    }
+    const double kmerIndexSeconds = std::max(timer.getTimediff(), 1e-9);
+
+    if (indexerSum != kmerIndexSum) {
+        Debug(Debug::ERROR) << "kmerIndex and Indexer::int2index disagree for k-mer size " << kmerSize << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    const double total = (double) kmerCount * (double) passes;
+    Debug(Debug::INFO) << "k-mer size: " << kmerSize
+                       << "\nk-mers: " << kmerCount << " x " << passes << " passes"
+                       << "\nIndexer::int2index: " << indexerSeconds << " s, " << indexerSeconds * 1e9 / total << " ns per k-mer"
+                       << "\nkmerIndex: " << kmerIndexSeconds << " s, " << kmerIndexSeconds * 1e9 / total << " ns per k-mer"
+                       << "\nSpeedup: " << indexerSeconds / kmerIndexSeconds << "\n";
+    return EXIT_SUCCESS;
+}
@@ -11,9 +11,17 @@
 #include "Matcher.h"
 #include "QueryTableEntry.h"
 #include "BlockAligner.h"
+#include "StripedAligner.h"
+#include "KmerIndex.h"
+#include "BatchUngappedAligner.h"
+#include "QueryDataCache.h"
+#include "ResultRunBuffer.h"
 
 #include "SRAUtil.h"
 
+#include <memory>
+#include <unordered_map>
+
 #ifdef OPENMP
 #include <omp.h>
 #endif
@@ -68,54 +76,97 @@ bool isWithinNDiagonals(const std::vector<QueryTableEntry> &queries, unsigned in
     return shortestDiagDistance <= N;
 }
 
-DistanceCalculator::LocalAlignment ungappedDiagFilter(
-        std::vector<QueryTableEntry> &queries,
-        const char *querySeqData, size_t querySeqLen,
-        const char *targetSeqData, size_t targetSeqLen,
-        const char **matrix, EvalueComputation &evaluer, int rescoreMode, double evalThr) {
-    int maxScore = INT_MIN;
-    DistanceCalculator::LocalAlignment alignmentResult;
-    unsigned int lastDiagonal = INVALID_DIAG;
-    for (size_t i = 1; i < queries.size(); ++i) {
-        if (queries[i].Result.diag == lastDiagonal) {
-            lastDiagonal = queries[i].Result.diag;
-            continue;
-        }
-        lastDiagonal = queries[i].Result.diag;
-
-        alignmentResult = DistanceCalculator::computeUngappedAlignment(
-            querySeqData, querySeqLen, targetSeqData, targetSeqLen,
-            queries[i].Result.diag, matrix, rescoreMode
-        );
+struct ChainAnchor {
+    int queryPos;
+    int targetPos;
 
-        if (alignmentResult.startPos < 0 || alignmentResult.endPos < 0) {
-            continue;
-        }
-
-        queries[i].Result.score = alignmentResult.score;
+    ChainAnchor(int queryPos, int targetPos) : queryPos(queryPos), targetPos(targetPos) {}
+};
 
-        // if (protein) {
-        // different than wiki, explain swap afterwards
-        double eval = evaluer.computeEvalue(alignmentResult.score, querySeqLen);
-        //                    Debug(Debug::ERROR) << k->Result.diag  << "\t" << aln.score <<  "\t" << eval << "\n";
+// anchors further back than this are not tried as predecessors
+const size_t CHAIN_MAX_LOOKBACK = 50;
 
-        // this is bad for nucleotide petasearch, we need to know the best diagonal
-        if (eval <= evalThr) {
-            maxScore = alignmentResult.score;
-            break;
+/**
+ * Co-linear chaining of the k-mer matches of one query/target pair.
+ * A match adds up to k residues that are not covered by its predecessor yet, shifting the diagonal between
+ * two matches costs the length of the shift. Returns the score of the best chain and the distinct diagonals
+ * of its matches in diags, the ones with the most matches first.
+ */
+int chainKmerMatches(std::vector<ChainAnchor> &anchors, int kmerSize, std::vector<int> &scores,
+                     std::vector<int> &prev, std::vector<unsigned int> &diags) {
+    diags.clear();
+    if (anchors.empty()) {
+        return 0;
+    }
+    std::sort(anchors.begin(), anchors.end(), [](const ChainAnchor &first, const ChainAnchor &second) {
+        if (first.targetPos != second.targetPos) {
+            return first.targetPos < second.targetPos;
+        }
+        return first.queryPos < second.queryPos;
+    });
+    scores.assign(anchors.size(), kmerSize);
+    prev.assign(anchors.size(), -1);
+    size_t bestEnd = 0;
+    for (size_t i = 0; i < anchors.size(); ++i) {
+        for (size_t j = i > CHAIN_MAX_LOOKBACK ? i - CHAIN_MAX_LOOKBACK : 0; j < i; ++j) {
+            const int queryDist = anchors[i].queryPos - anchors[j].queryPos;
+            const int targetDist = anchors[i].targetPos - anchors[j].targetPos;
+            if (queryDist <= 0 || targetDist <= 0) {
+                continue;
+            }
+            const int gain = std::min(std::min(queryDist, targetDist), kmerSize);
+            const int score = scores[j] + gain - std::abs(queryDist - targetDist);
+            if (score > scores[i]) {
+                scores[i] = score;
+                prev[i] = (int) j;
+            }
+        }
+        if (scores[i] > scores[bestEnd]) {
+            bestEnd = i;
         }
-        // } else {
-        // actually calculate maxscore
-        // }
     }
 
-
-    if (maxScore == INT_MIN) {
-        alignmentResult.diagonal = INVALID_DIAG;
+    // (count, diagonal) of the chain, in chain order
+    std::vector<std::pair<int, unsigned int>> counts;
+    for (int i = (int) bestEnd; i != -1; i = prev[i]) {
+        const unsigned int diag = anchors[i].queryPos - anchors[i].targetPos;
+        bool found = false;
+        for (size_t j = 0; j < counts.size(); ++j) {
+            if (counts[j].second == diag) {
+                counts[j].first++;
+                found = true;
+                break;
+            }
+        }
+        if (found == false) {
+            counts.emplace_back(1, diag);
+        }
     }
-    return alignmentResult;
+    std::reverse(counts.begin(), counts.end());
+    std::stable_sort(counts.begin(), counts.end(), [](const std::pair<int, unsigned int> &first,
+                                                      const std::pair<int, unsigned int> &second) {
+        return first.first > second.first;
+    });
+    for (size_t j = 0; j < counts.size(); ++j) {
+        diags.emplace_back(counts[j].second);
+    }
+    return scores[bestEnd];
 }
 
+// a group of k-mer matches between one query and the current target, which passed the two-hit rule or the chain filter
+struct UngappedCandidate {
+    unsigned int queryKey;
+    unsigned int querySeqLen;
+    // query sequence (consensus for profiles) in the per-target sequence buffer
+    size_t seqOffset;
+    // distinct consecutive diagonals of the group to try in order, and the next one to try
+    size_t diagStart;
+    size_t diagEnd;
+    size_t nextDiag;
+    // first ungapped alignment that passes the e-value threshold, diagonal is INVALID_DIAG if there is none
+    DistanceCalculator::LocalAlignment aln;
+};
+
 struct Kmer {
     unsigned long long kmer = -1;
     int kmerPos = -1;
@@ -161,6 +212,304 @@ struct BlockIterator {
     char *buffer;
 };
 
+// prepared data of a query, entries that are not cached yet are read and their profile consensus extracted
+QueryDataCache::Entry *getQueryData(
+        QueryDataCache &cache, DBReader<unsigned int> &querySequenceReader, unsigned int queryKey,
+        bool useProfileSearch, BaseMatrix &subMat, unsigned int thread_idx) {
+    QueryDataCache::Entry *entry = cache.get(queryKey);
+    if (entry != NULL) {
+        return entry;
+    }
+    entry = cache.insert(queryKey);
+    unsigned int queryId = querySequenceReader.getId(queryKey);
+    const char *querySeqData = querySequenceReader.getData(queryId, thread_idx);
+    entry->seqLen = querySequenceReader.getSeqLen(queryId);
+    if (useProfileSearch) {
+        const unsigned int queryEntryLen = querySequenceReader.getEntryLen(queryId);
+        entry->profile.assign(querySeqData, queryEntryLen - 1);
+        Sequence::extractProfileConsensus(querySeqData, queryEntryLen - 1, subMat, entry->seq);
+        if (entry->seq.length() != entry->seqLen) {
+            Debug(Debug::ERROR) << "Query sequence length is wrong!\n"
+                                << "Query key: " << queryKey << "\n"
+                                << "Retrieved sequence length: " << entry->seqLen << "\n"
+                                << "Newly measured sequence length: " << entry->seq.length() << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+    } else {
+        entry->seq.assign(querySeqData, entry->seqLen);
+    }
+    return entry;
+}
+
+// per-thread state of the gapped alignment, work items use the state of the thread that runs them
+struct AlignWorker {
+    BlockAligner blockAligner;
+    // pairs up to stripedMaxLength are aligned with Smith-Waterman, NULL if --sw-max-len is 0
+    StripedAligner *stripedAligner;
+    unsigned int stripedMaxLength;
+    QueryDataCache queryCache;
+    ResultRunBuffer results;
+    size_t alignmentsNum;
+    size_t totalPassedNum;
+    size_t zeroLengthSeqs;
+
+    AlignWorker(const LocalParameters &par, int8_t gapOpen, int8_t gapExtend, BaseMatrix &subMat, int queryDbtype,
+                unsigned int thread_idx)
+        : blockAligner(par.maxSeqLen, par.rangeMin, par.rangeMax, gapOpen, gapExtend, subMat, queryDbtype, par.adaptiveRange),
+          stripedAligner(NULL),
+          stripedMaxLength(Parameters::isEqualDbtype(queryDbtype, Parameters::DBTYPE_HMM_PROFILE)
+                           ? par.swMaxLen.values.profile() : par.swMaxLen.values.sequence()),
+          queryCache(par.queryCacheSize),
+          results(par.db4 + "_spill." + SSTR(thread_idx), par.resultMemoryLimit, matcherResultsSort),
+          alignmentsNum(0), totalPassedNum(0), zeroLengthSeqs(0) {
+        if (stripedMaxLength > 0) {
+            stripedAligner = new StripedAligner(stripedMaxLength, gapOpen, gapExtend, subMat, queryDbtype);
+        }
+    }
+
+    ~AlignWorker() {
+        delete stripedAligner;
+    }
+};
+
+// targets with more candidates are split into work items of this many candidates
+const size_t GAPPED_WORK_ITEM_SIZE = 32;
+
+// a target shared by its work items, the last one to finish releases it
+struct TargetWork {
+    unsigned int targetKey;
+    unsigned int targetLength;
+    unsigned int targetSeqLen;
+    std::string targetSeq;
+    std::vector<UngappedCandidate> candidates;
+};
+
+// gapped alignment of the candidates [begin, end) of a target, the target is the query side of block aligner
+// targetLength is the length of the decoded sequence, targetSeqLen the one reported in the results
+void alignCandidates(
+        AlignWorker &worker, unsigned int targetKey, const char *targetSeqData, unsigned int targetLength, unsigned int targetSeqLen,
+        const std::vector<UngappedCandidate> &candidates, size_t begin, size_t end,
+        DBReader<unsigned int> &querySequenceReader, bool useProfileSearch, BaseMatrix &subMat,
+        EvalueComputation &evaluer, const LocalParameters &par, unsigned int thread_idx) {
+    worker.blockAligner.setQuery(targetKey, targetSeqData, targetLength);
+    if (worker.stripedAligner != NULL) {
+        worker.stripedAligner->setQuery(targetKey, targetSeqData, targetLength);
+    }
+    for (size_t c = begin; c < end; ++c) {
+        const DistanceCalculator::LocalAlignment &aln = candidates[c].aln;
+        const unsigned int queryKey = candidates[c].queryKey;
+        const unsigned int querySeqLen = candidates[c].querySeqLen;
+
+        // for (size_t i = 0; i < queries.size(); ++i) {
+        //     Debug(Debug::WARNING) << queries[i].querySequenceId << "\t" << queries[i].targetSequenceID << "\n";
+        //     Debug(Debug::WARNING) << queries[i].Query.kmerPosInQuery << "\t" << queries[i].Query.kmer << "\n";
+        // }
+        // Debug(Debug::WARNING) << "querySeqData: " << querySeqData << "\n";
+        // Debug(Debug::WARNING) << "targetSeqData: " << targetSeqData << "\n";
+        // Debug(Debug::WARNING) << "diagonal: " << aln.diagonal << "\n";
+        // Debug(Debug::WARNING) << "score: " << aln.score << "\n";
+        // Debug(Debug::WARNING) << "distToDiagonal: " << aln.distToDiagonal << "\n";
+        // Debug(Debug::WARNING) << "startPos: " << aln.startPos << "\n";
+        // Debug(Debug::WARNING) << "endPos: " << aln.endPos << "\n";
+        // unsigned int qUngappedStartPos = aln.startPos + ((aln.diagonal >= 0) ? aln.distToDiagonal : 0);
+        // unsigned int qUngappedEndPos = aln.endPos + ((aln.diagonal >= 0) ? aln.distToDiagonal : 0);
+        // unsigned int dbUngappedStartPos = aln.startPos + ((aln.diagonal >= 0) ? 0 : aln.distToDiagonal);
+        // unsigned int dbUngappedEndPos = aln.endPos + ((aln.diagonal >= 0) ? 0 : aln.distToDiagonal);
+        // Debug(Debug::INFO) << "qUnGapStart: " << qUngappedStartPos << "\n";
+        // Debug(Debug::INFO) << "qUnGapEnd: " << qUngappedEndPos << "\n";
+        // Debug(Debug::INFO) << "dbUnGapStart: " << dbUngappedStartPos << "\n";
+        // Debug(Debug::INFO) << "dbUnGapEnd: " << dbUngappedEndPos << "\n";
+        // Debug(Debug::INFO) << std::string(querySeqData + qUngappedStartPos, qUngappedEndPos - qUngappedStartPos) << "\n";
+        // Debug(Debug::INFO) << std::string(targetSeqData + dbUngappedStartPos, dbUngappedEndPos - dbUngappedStartPos) << "\n";
+        // EXIT(EXIT_FAILURE);
+
+        // if (aln.diagonal == (int) INVALID_DIAG || aln.startPos < 0 || aln.endPos < 0 || aln.distToDiagonal > std::max((int)querySeqLen, targetSeq.L)) {
+        if (aln.diagonal == (int) INVALID_DIAG) {
+            continue;
+        }
+        QueryDataCache::Entry *queryData = getQueryData(
+            worker.queryCache, querySequenceReader, queryKey, useProfileSearch, subMat, thread_idx
+        );
+        const char *querySeqData = useProfileSearch ? queryData->profile.c_str() : queryData->seq.c_str();
+
+        // Debug(Debug::ERROR) << querySeqData << "\t" << querySeqLen << "\n";
+        // Debug(Debug::ERROR) << targetSeqData << "\t" << targetSeq.L << "\n";
+
+        // querySeq.mapSequence(queryId, queryKey, querySeqData, querySeqLen);
+        // matcher.initQuery(&querySeq);
+        // Matcher::result_t res = matcher.getSWResult(&targetSeq, INT_MAX, false, 0, 0.0, par.evalThr, Matcher::SCORE_COV_SEQID, 0, false);
+        std::string backtrace;
+        s_align blk;
+        if (worker.stripedAligner != NULL && std::max(targetLength, querySeqLen) <= worker.stripedMaxLength) {
+            // short pairs can be faster with Smith-Waterman, which does not need the seed
+            blk = worker.stripedAligner->alignTarget(queryKey, querySeqData, querySeqLen, backtrace, &evaluer, par.evalThr);
+        } else {
+            // the gapped alignment extends the ungapped alignment of the diagonal filter, with swapped roles
+            BlockAligner::LocalAln seed = BlockAligner::fromUngapped(aln);
+            std::swap(seed.a_start, seed.b_start);
+            std::swap(seed.a_end, seed.b_end);
+            if (queryData->aligned.getKey() != queryKey) {
+                worker.blockAligner.loadTarget(queryData->aligned, queryKey, querySeqData, querySeqLen);
+            }
+            blk = worker.blockAligner.alignTarget(
+                queryData->aligned,
+                seed,
+                backtrace,
+                &evaluer,
+                par.xdrop,
+                par.evalThr
+            );
+        }
+        if (blk.evalue > par.evalThr) {
+            // rejected after the score-only pass, no traceback was computed
+            worker.alignmentsNum++;
+            continue;
+        }
+        Matcher::result_t res(
+            targetKey,
+            blk.score1,
+            blk.qCov,
+            blk.tCov,
+            blk.identicalAACnt / std::max(blk.cigarLen, 1),
+            blk.evalue,
+            blk.cigarLen,
+            blk.qStartPos1,
+            blk.qEndPos1,
+            querySeqLen,
+            blk.dbStartPos1,
+            blk.dbEndPos1,
+            targetSeqLen,
+            // buffered results only keep the compressed backtrace, and none if it is not written
+            par.addBacktrace ? Matcher::compressAlignment(backtrace) : ""
+        );
+
+        if (blk.cigarLen == 0) {
+            worker.zeroLengthSeqs++;
+            continue;
+        }
+
+        res.queryOrfStartPos = queryKey;
+        worker.alignmentsNum++;
+
+        if (res.eval <= par.evalThr) {
+            worker.results.add(res);
+            worker.totalPassedNum++;
+        }
+//        Debug(Debug::INFO) << "Backtrace: " << res.backtrace << "\n";
+//        Debug(Debug::INFO) << printAlnFromBt(targetSeqData, res.qStartPos, res.backtrace, false) << "\t"
+//                           << targetKey
+//                           << "\t" << res.qStartPos << "\t" << targetSeqLen << "\n";
+//        Debug(Debug::INFO) << printAlnFromBt(querySeqData, res.dbStartPos, res.backtrace, true) << "\t"
+//                           << queryKey
+//                           << "\t" << res.dbStartPos << "\t" << querySeqLen << "\n" << res.eval << "\t"
+//                           << res.alnLength
+//                           << "\n\n";
+    }
+}
+
+// state shared by all gapped alignments, work items keep a pointer to it
+struct GappedContext {
+    std::vector<AlignWorker *> *workers;
+    DBReader<unsigned int> *querySequenceReader;
+    bool useProfileSearch;
+    BaseMatrix *subMat;
+    EvalueComputation *evaluer;
+    const LocalParameters *par;
+};
+
+// light targets are aligned right away, heavy ones are split into work items so that threads that run out of
+// targets can pick them up at the end of the loop, their candidates are moved into the work items
+void alignTargetCandidates(const GappedContext *context, unsigned int thread_idx, unsigned int targetKey,
+                           const char *targetSeqData, unsigned int targetLength, unsigned int targetSeqLen,
+                           std::vector<UngappedCandidate> &candidates) {
+    if (candidates.size() <= GAPPED_WORK_ITEM_SIZE) {
+        alignCandidates(
+            *(*context->workers)[thread_idx], targetKey, targetSeqData, targetLength, targetSeqLen, candidates, 0, candidates.size(),
+            *context->querySequenceReader, context->useProfileSearch, *context->subMat, *context->evaluer, *context->par, thread_idx
+        );
+        return;
+    }
+    // the target is copied out of the per-thread buffers
+    std::shared_ptr<TargetWork> work = std::make_shared<TargetWork>();
+    work->targetKey = targetKey;
+    work->targetLength = targetLength;
+    work->targetSeqLen = targetSeqLen;
+    work->targetSeq.assign(targetSeqData, targetLength);
+    work->candidates.swap(candidates);
+    for (size_t begin = 0; begin < work->candidates.size(); begin += GAPPED_WORK_ITEM_SIZE) {
+        const size_t end = std::min(begin + GAPPED_WORK_ITEM_SIZE, work->candidates.size());
+#pragma omp task firstprivate(context, work, begin, end)
+        {
+            unsigned int task_thread_idx = 0;
+#ifdef OPENMP
+            task_thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+            alignCandidates(
+                *(*context->workers)[task_thread_idx], work->targetKey, work->targetSeq.c_str(),
+                work->targetLength, work->targetSeqLen,
+                work->candidates, begin, end,
+                *context->querySequenceReader, context->useProfileSearch, *context->subMat, *context->evaluer,
+                *context->par, task_thread_idx
+            );
+        }
+    }
+}
+
+// a candidate that passed the ungapped filter
+struct RankedCandidate {
+    unsigned int queryKey;
+    unsigned int targetKey;
+    int score;
+};
+
+// best ungapped score first, ties are broken by the target key
+bool rankedBefore(const RankedCandidate &first, const RankedCandidate &second) {
+    if (first.score != second.score) {
+        return first.score > second.score;
+    }
+    return first.targetKey < second.targetKey;
+}
+
+// the candidates of a target that passed the ungapped filter, kept until all targets are ranked
+struct RankedTarget {
+    unsigned int targetKey;
+    std::vector<UngappedCandidate> candidates;
+};
+
+// stores the last candidate to align for each query with more than maxSeqs candidates
+void computeRankLimits(const std::vector<std::vector<RankedTarget>> &rankedTargets, size_t maxSeqs,
+                       std::unordered_map<unsigned int, RankedCandidate> &limits) {
+    std::vector<RankedCandidate> all;
+    for (size_t t = 0; t < rankedTargets.size(); ++t) {
+        for (size_t i = 0; i < rankedTargets[t].size(); ++i) {
+            const RankedTarget &rankedTarget = rankedTargets[t][i];
+            for (size_t j = 0; j < rankedTarget.candidates.size(); ++j) {
+                RankedCandidate rankedCandidate;
+                rankedCandidate.queryKey = rankedTarget.candidates[j].queryKey;
+                rankedCandidate.targetKey = rankedTarget.targetKey;
+                rankedCandidate.score = rankedTarget.candidates[j].aln.score;
+                all.emplace_back(rankedCandidate);
+            }
+        }
+    }
+    SORT_SERIAL(all.begin(), all.end(), [](const RankedCandidate &first, const RankedCandidate &second) {
+        if (first.queryKey != second.queryKey) {
+            return first.queryKey < second.queryKey;
+        }
+        return rankedBefore(first, second);
+    });
+    for (size_t start = 0; start < all.size();) {
+        size_t end = start + 1;
+        while (end < all.size() && all[end].queryKey == all[start].queryKey) {
+            ++end;
+        }
+        if (end - start > maxSeqs) {
+            limits[all[start].queryKey] = all[start + maxSeqs - 1];
+        }
+        start = end;
+    }
+}
+
 int blockalign(int argc, const char **argv, const Command &command) {
     Timer timer;
     LocalParameters &par = LocalParameters::getLocalInstance();
@@ -198,33 +547,57 @@ int blockalign(int argc, const char **argv, const Command &command) {
     } else {
         subMat = new SubstitutionMatrix(par.scoringMatrixFile.values.aminoacid().c_str(), 2.0, 0.0);
     }
+    // k-mers have to be extracted in the same (reduced) alphabet as in createkmertable and comparekmertables
+    BaseMatrix *kmerMat = subMat;
+    if (isNucDB == false && par.alphabetSize.values.aminoacid() < 21) {
+        kmerMat = SRAUtil::getKmerMatrix(par, false, 8.0, -0.2f);
+    }
     SubstitutionMatrix::FastMatrix fastMatrix = SubstitutionMatrix::createAsciiSubMat(*subMat);
     EvalueComputation evaluer(targetSequenceReader.getAminoAcidDBSize(), subMat);
 
-    const int xdrop = par.xdrop;
-
     size_t kmerMatch = 0;
     size_t ungappedNum = 0;
     size_t alignmentsNum = 0;
     size_t totalPassedNum = 0;
     size_t zeroLengthSeqs = 0;
     Debug::Progress progress(resultReader.getSize());
-#pragma omp parallel reduction(+:kmerMatch, ungappedNum, alignmentsNum, totalPassedNum, zeroLengthSeqs)
+    size_t queryCacheHits = 0;
+    size_t queryCacheLookups = 0;
+    size_t rankDroppedNum = 0;
+    std::vector<AlignWorker *> workers(par.threads, NULL);
+    GappedContext context;
+    context.workers = &workers;
+    context.querySequenceReader = &querySequenceReader;
+    context.useProfileSearch = useProfileSearch;
+    context.subMat = subMat;
+    context.evaluer = &evaluer;
+    context.par = &par;
+    // with --max-aligned-seqs the candidates of all targets are kept and ranked per query before the gapped alignment
+    const bool rankCandidates = par.maxAlignedSeqs > 0;
+    std::vector<std::vector<RankedTarget>> rankedTargets(par.threads);
+    std::vector<RankedTarget *> rankedOrder;
+    std::unordered_map<unsigned int, RankedCandidate> rankLimits;
+#pragma omp parallel reduction(+:kmerMatch, ungappedNum, alignmentsNum, totalPassedNum, zeroLengthSeqs, queryCacheHits, queryCacheLookups, rankDroppedNum)
     {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
         thread_idx = static_cast<unsigned int>(omp_get_thread_num());
 #endif
         Sequence targetSeq(par.maxSeqLen, seqType, subMat, par.kmerSize, par.spacedKmer, false, false, par.spacedKmerPattern);
+        Sequence *reducedSeq = NULL;
+        if (kmerMat != subMat) {
+            reducedSeq = new Sequence(par.maxSeqLen, seqType, kmerMat, par.kmerSize, par.spacedKmer, false, false, par.spacedKmerPattern);
+        }
 
-        Indexer idx(subMat->alphabetSize - 1, par.kmerSize);
+        Indexer idx(kmerMat->alphabetSize - 1, par.kmerSize);
 
-        BlockAligner blockAligner(
-            par.maxSeqLen, par.rangeMin, par.rangeMax,
+        workers[thread_idx] = new AlignWorker(
+            par,
             isNucDB ? -par.gapOpen.values.nucleotide() : -par.gapOpen.values.aminoacid(),
             isNucDB ? -par.gapExtend.values.nucleotide() : -par.gapExtend.values.aminoacid(),
             *subMat,
-            querySequenceReader.getDbtype()
+            querySequenceReader.getDbtype(),
+            thread_idx
         );
 
         // Sequence querySeq(par.maxSeqLen, querySequenceReader.getDbtype(), subMat, 0, false, false, false);
@@ -232,26 +605,38 @@ int blockalign(int argc, const char **argv, const Command &command) {
 
         char buffer[1024];
 
-        std::vector<Matcher::result_t> results;
-        results.reserve(300);
-
         std::string result;
         result.reserve(1000);
 
-        std::string realSeq;
-        realSeq.reserve(1000);
-
         std::vector<QueryTableEntry> queries;
         queries.reserve(300);
 
         BlockIterator it;
 
+        // the candidates of one target, their ungapped alignments are computed together
+        BatchUngappedAligner ungappedAligner(fastMatrix.matrix, par.rescoreMode);
+        std::vector<UngappedCandidate> candidates;
+        std::vector<unsigned int> candidateDiags;
+        std::vector<size_t> pending;
+        std::string candidateSeqs;
+
+        std::vector<ChainAnchor> anchors;
+        std::vector<int> chainScores;
+        std::vector<int> chainPrev;
+        std::vector<unsigned int> chainDiags;
+
         unsigned long correct_count = 0;
-#pragma omp for schedule(dynamic, 10)
+        const size_t targetChunkSize = 10;
+#pragma omp for schedule(dynamic, targetChunkSize)
         for (size_t i = 0; i < resultReader.getSize(); ++i) {
             progress.updateProgress();
 
             unsigned int targetKey = resultReader.getDbKey(i);
+            // the next target of this thread's chunk is read from disk while this one is aligned,
+            // the first target of a chunk is not prefetched since the chunk may go to another thread
+            if ((i + 1) % targetChunkSize != 0 && i + 1 < resultReader.getSize()) {
+                targetSequenceReader.prefetch(resultReader.getDbKey(i + 1));
+            }
             const unsigned int targetSeqLen = targetSequenceReader.getSeqLen(targetKey);
 
             if (targetSeqLen < (unsigned int)par.kmerSize) {
@@ -261,22 +646,27 @@ int blockalign(int argc, const char **argv, const Command &command) {
             const char *targetSeqData = targetSequenceReader.getData(targetKey, thread_idx);
             targetSeq.mapSequence(targetKey, targetKey, targetSeqData, targetSeqLen);
 
-            unsigned int queryKey = -1;
-
-            bool isBlockAlignerInit = false;
-
+            Sequence *kmerSeq = &targetSeq;
+            if (reducedSeq != NULL) {
+                reducedSeq->mapSequence(targetKey, targetKey, targetSeqData, targetSeqLen);
+                kmerSeq = reducedSeq;
+            }
             std::vector<Kmer> targetKmers;
             targetKmers.reserve(targetSeqLen - par.kmerSize);
-            while (targetSeq.hasNextKmer()) {
-                const unsigned char *kmer = targetSeq.nextKmer();
-                targetKmers.emplace_back(idx.int2index(kmer, 0, par.kmerSize), targetSeq.getCurrentPosition());
+            while (kmerSeq->hasNextKmer()) {
+                const unsigned char *kmer = kmerSeq->nextKmer();
+                targetKmers.emplace_back(kmerIndex(kmer, idx.powers, par.kmerSize), kmerSeq->getCurrentPosition());
             }
             SORT_SERIAL(targetKmers.begin(), targetKmers.end(), kmerComparator);
 
-            // TODO: prefetch next sequence
             char *data = resultReader.getData(i, thread_idx);
             it.reset(data);
+            candidates.clear();
+            candidateDiags.clear();
+            candidateSeqs.clear();
+            pending.clear();
             while (it.getNext(queries)) {
+                anchors.clear();
                 for (size_t j = 0; j < queries.size(); ++j) {
                     QueryTableEntry &query = queries[j];
                     const auto kmer = std::lower_bound(targetKmers.begin(), targetKmers.end(),
@@ -286,6 +676,10 @@ int blockalign(int argc, const char **argv, const Command &command) {
                                                        });
                     bool kmerFound = kmer != targetKmers.end() && query.Query.kmer == kmer->kmer;
                     if (kmerFound) {
+                        if (par.chainMinScore > 0) {
+                            // the query position shares its memory with the diagonal
+                            anchors.emplace_back((int) query.Query.kmerPosInQuery, kmer->kmerPos);
+                        }
                         query.Result.diag = query.Query.kmerPosInQuery - kmer->kmerPos;
                     } else {
                         Debug(Debug::ERROR) 
@@ -299,129 +693,96 @@ int blockalign(int argc, const char **argv, const Command &command) {
                 }
                 kmerMatch++;
 
-                SORT_SERIAL(queries.begin(), queries.end(), blockByDiagSort);
-                if (isWithinNDiagonals(queries, 4) == false) {
-                    continue;
-                }
-
-                queryKey = queries[0].querySequenceId;
-                unsigned int queryId = querySequenceReader.getId(queryKey);
-                const char *querySeqData = querySequenceReader.getData(queryId, thread_idx);
-                const unsigned int querySeqLen = querySequenceReader.getSeqLen(queryId);
-                const unsigned int queryEntryLen = querySequenceReader.getEntryLen(queryId);
-
-                if (useProfileSearch) {
-                    realSeq.clear();
-                    Sequence::extractProfileConsensus(querySeqData, queryEntryLen - 1, *subMat, realSeq);
-                    if (realSeq.length() != querySeqLen) {
-                        Debug(Debug::ERROR) << "Query sequence length is wrong!\n" 
-                                            << "Correct count: " << correct_count << "\n"
-                                            << "Retrieved sequence length: " << querySeqLen << "\n"
-                                            << "Newly measured sequence length: " << realSeq.length() << "\n";
-                        EXIT(EXIT_FAILURE);
+                if (par.chainMinScore > 0) {
+                    if (chainKmerMatches(anchors, par.kmerSize, chainScores, chainPrev, chainDiags) < par.chainMinScore) {
+                        continue;
+                    }
+                } else {
+                    SORT_SERIAL(queries.begin(), queries.end(), blockByDiagSort);
+                    if (isWithinNDiagonals(queries, 4) == false) {
+                        continue;
                     }
                 }
 
-                correct_count++;
-                DistanceCalculator::LocalAlignment aln = ungappedDiagFilter(
-                    queries,
-                    useProfileSearch ? realSeq.c_str() : querySeqData,
-                    querySeqLen,
-                    targetSeqData,
-                    targetSeqLen,
-                    fastMatrix.matrix,
-                    evaluer,
-                    par.rescoreMode,
-                    par.evalThr
+                UngappedCandidate candidate;
+                candidate.queryKey = queries[0].querySequenceId;
+                const QueryDataCache::Entry *queryData = getQueryData(
+                    workers[thread_idx]->queryCache, querySequenceReader, candidate.queryKey, useProfileSearch, *subMat, thread_idx
                 );
-                ungappedNum++;
 
-                // for (size_t i = 0; i < queries.size(); ++i) {
-                //     Debug(Debug::WARNING) << queries[i].querySequenceId << "\t" << queries[i].targetSequenceID << "\n";
-                //     Debug(Debug::WARNING) << queries[i].Query.kmerPosInQuery << "\t" << queries[i].Query.kmer << "\n";
-                // }
-                // Debug(Debug::WARNING) << "querySeqData: " << querySeqData << "\n";
-                // Debug(Debug::WARNING) << "targetSeqData: " << targetSeqData << "\n";
-                // Debug(Debug::WARNING) << "diagonal: " << aln.diagonal << "\n";
-                // Debug(Debug::WARNING) << "score: " << aln.score << "\n";
-                // Debug(Debug::WARNING) << "distToDiagonal: " << aln.distToDiagonal << "\n";
-                // Debug(Debug::WARNING) << "startPos: " << aln.startPos << "\n";
-                // Debug(Debug::WARNING) << "endPos: " << aln.endPos << "\n";
-                // unsigned int qUngappedStartPos = aln.startPos + ((aln.diagonal >= 0) ? aln.distToDiagonal : 0);
-                // unsigned int qUngappedEndPos = aln.endPos + ((aln.diagonal >= 0) ? aln.distToDiagonal : 0);
-                // unsigned int dbUngappedStartPos = aln.startPos + ((aln.diagonal >= 0) ? 0 : aln.distToDiagonal);
-                // unsigned int dbUngappedEndPos = aln.endPos + ((aln.diagonal >= 0) ? 0 : aln.distToDiagonal);
-                // Debug(Debug::INFO) << "qUnGapStart: " << qUngappedStartPos << "\n";
-                // Debug(Debug::INFO) << "qUnGapEnd: " << qUngappedEndPos << "\n";
-                // Debug(Debug::INFO) << "dbUnGapStart: " << dbUngappedStartPos << "\n";
-                // Debug(Debug::INFO) << "dbUnGapEnd: " << dbUngappedEndPos << "\n";
-                // Debug(Debug::INFO) << std::string(querySeqData + qUngappedStartPos, qUngappedEndPos - qUngappedStartPos) << "\n";
-                // Debug(Debug::INFO) << std::string(targetSeqData + dbUngappedStartPos, dbUngappedEndPos - dbUngappedStartPos) << "\n";
-                // EXIT(EXIT_FAILURE);
-
-                // if (aln.diagonal == (int) INVALID_DIAG || aln.startPos < 0 || aln.endPos < 0 || aln.distToDiagonal > std::max((int)querySeqLen, targetSeq.L)) {
-                if (aln.diagonal == (int) INVALID_DIAG) {
-                    continue;
+                correct_count++;
+                candidate.querySeqLen = queryData->seqLen;
+                // cache entries can be evicted by later candidates, keep a copy until the gapped alignments
+                candidate.seqOffset = candidateSeqs.size();
+                candidateSeqs.append(queryData->seq);
+                candidate.diagStart = candidateDiags.size();
+                if (par.chainMinScore > 0) {
+                    candidateDiags.insert(candidateDiags.end(), chainDiags.begin(), chainDiags.end());
+                } else {
+                    unsigned int lastDiagonal = INVALID_DIAG;
+                    for (size_t j = 1; j < queries.size(); ++j) {
+                        if (queries[j].Result.diag != lastDiagonal) {
+                            candidateDiags.push_back(queries[j].Result.diag);
+                        }
+                        lastDiagonal = queries[j].Result.diag;
+                    }
                 }
-
-                if (isBlockAlignerInit == false) {
-                    isBlockAlignerInit = true;
+                candidate.diagEnd = candidateDiags.size();
+                candidate.nextDiag = candidate.diagStart;
+                candidate.aln.diagonal = INVALID_DIAG;
+                if (candidate.diagStart < candidate.diagEnd) {
+                    pending.emplace_back(candidates.size());
                 }
+                candidates.emplace_back(candidate);
+                ungappedNum++;
+            }
 
-                // Debug(Debug::ERROR) << querySeqData << "\t" << querySeqLen << "\n";
-                // Debug(Debug::ERROR) << targetSeqData << "\t" << targetSeq.L << "\n";
-
-                // querySeq.mapSequence(queryId, queryKey, querySeqData, querySeqLen);
-                // matcher.initQuery(&querySeq);
-                // Matcher::result_t res = matcher.getSWResult(&targetSeq, INT_MAX, false, 0, 0.0, par.evalThr, Matcher::SCORE_COV_SEQID, 0, false);
-                std::string backtrace;
-                s_align blk = blockAligner.align(
-                    targetSeqData, NULL, targetSeq.L,
-                    querySeqData, realSeq.empty() ? NULL : realSeq.c_str(), querySeqLen,
-                    -aln.diagonal,
-                    backtrace,
-                    &evaluer,
-                    xdrop
-                );
-                Matcher::result_t res(
-                    targetKey,
-                    blk.score1,
-                    blk.qCov,
-                    blk.tCov,
-                    blk.identicalAACnt / std::max(blk.cigarLen, 1),
-                    blk.evalue,
-                    blk.cigarLen,
-                    blk.qStartPos1,
-                    blk.qEndPos1,
-                    querySeqLen,
-                    blk.dbStartPos1,
-                    blk.dbEndPos1,
-                    targetSeqLen,
-                    backtrace
-                );
-
-                if (blk.cigarLen == 0) {
-                    zeroLengthSeqs++;
-                    continue;
+            // diagonal filter: every round computes the next diagonal of all candidates that did not pass yet
+            // this is bad for nucleotide petasearch, we need to know the best diagonal
+            while (pending.empty() == false) {
+                ungappedAligner.clear();
+                for (size_t j = 0; j < pending.size(); ++j) {
+                    const UngappedCandidate &candidate = candidates[pending[j]];
+                    ungappedAligner.add(
+                        candidateSeqs.data() + candidate.seqOffset, candidate.querySeqLen,
+                        targetSeqData, targetSeqLen,
+                        candidateDiags[candidate.nextDiag]
+                    );
                 }
+                ungappedAligner.align();
+                size_t remaining = 0;
+                for (size_t j = 0; j < pending.size(); ++j) {
+                    UngappedCandidate &candidate = candidates[pending[j]];
+                    const DistanceCalculator::LocalAlignment &aln = ungappedAligner.getAlignment(j);
+                    if (aln.startPos >= 0 && aln.endPos >= 0
+                        && evaluer.computeEvalue(aln.score, candidate.querySeqLen) <= par.evalThr) {
+                        candidate.aln = aln;
+                        continue;
+                    }
+                    candidate.nextDiag++;
+                    if (candidate.nextDiag < candidate.diagEnd) {
+                        pending[remaining++] = pending[j];
+                    }
+                }
+                pending.resize(remaining);
+            }
 
-                res.queryOrfStartPos = queryKey;
-                alignmentsNum++;
-
-                if (res.eval <= par.evalThr) {
-                    results.emplace_back(res);
-                    totalPassedNum++;
+            if (rankCandidates) {
+                // the gapped alignments wait until the candidates of all targets are ranked
+                RankedTarget rankedTarget;
+                rankedTarget.targetKey = targetKey;
+                for (size_t j = 0; j < candidates.size(); ++j) {
+                    if (candidates[j].aln.diagonal != (int) INVALID_DIAG) {
+                        rankedTarget.candidates.emplace_back(candidates[j]);
+                    }
+                }
+                if (rankedTarget.candidates.empty() == false) {
+                    rankedTargets[thread_idx].emplace_back();
+                    std::swap(rankedTargets[thread_idx].back(), rankedTarget);
                 }
-//                Debug(Debug::INFO) << "Backtrace: " << res.backtrace << "\n";
-//                Debug(Debug::INFO) << printAlnFromBt(targetSeqData, res.qStartPos, res.backtrace, false) << "\t"
-//                                   << targetKey
-//                                   << "\t" << res.qStartPos << "\t" << targetSeqLen << "\n";
-//                Debug(Debug::INFO) << printAlnFromBt(querySeqData, res.dbStartPos, res.backtrace, true) << "\t"
-//                                   << queryKey
-//                                   << "\t" << res.dbStartPos << "\t" << querySeqLen << "\n" << res.eval << "\t"
-//                                   << res.alnLength
-//                                   << "\n\n";
+                continue;
             }
+            alignTargetCandidates(&context, thread_idx, targetKey, targetSeqData, targetSeq.L, targetSeqLen, candidates);
 //            std::sort(results.begin(), results.end(), Matcher::compareHits);
 //            for (size_t j = 0; j < results.size(); ++j) {
 //                size_t len = Matcher::resultToBuffer(buffer, results[j], false, false);
@@ -432,16 +793,71 @@ int blockalign(int argc, const char **argv, const Command &command) {
 //            result.clear();
         }
 
-        SORT_SERIAL(results.begin(), results.end(), matcherResultsSort);
+        if (rankCandidates) {
+#pragma omp single
+            {
+                computeRankLimits(rankedTargets, par.maxAlignedSeqs, rankLimits);
+                for (size_t t = 0; t < rankedTargets.size(); ++t) {
+                    for (size_t j = 0; j < rankedTargets[t].size(); ++j) {
+                        rankedOrder.emplace_back(&rankedTargets[t][j]);
+                    }
+                }
+            }
+#pragma omp for schedule(dynamic, 1)
+            for (size_t i = 0; i < rankedOrder.size(); ++i) {
+                RankedTarget &rankedTarget = *rankedOrder[i];
+                if (i + 1 < rankedOrder.size()) {
+                    targetSequenceReader.prefetch(rankedOrder[i + 1]->targetKey);
+                }
+                std::vector<UngappedCandidate> &targetCandidates = rankedTarget.candidates;
+                size_t kept = 0;
+                for (size_t j = 0; j < targetCandidates.size(); ++j) {
+                    RankedCandidate rankedCandidate;
+                    rankedCandidate.queryKey = targetCandidates[j].queryKey;
+                    rankedCandidate.targetKey = rankedTarget.targetKey;
+                    rankedCandidate.score = targetCandidates[j].aln.score;
+                    std::unordered_map<unsigned int, RankedCandidate>::const_iterator limit = rankLimits.find(rankedCandidate.queryKey);
+                    if (limit != rankLimits.end() && rankedBefore(limit->second, rankedCandidate)) {
+                        rankDroppedNum++;
+                        continue;
+                    }
+                    targetCandidates[kept++] = targetCandidates[j];
+                }
+                targetCandidates.resize(kept);
+                if (kept > 0) {
+                    const unsigned int targetKey = rankedTarget.targetKey;
+                    const unsigned int targetSeqLen = targetSequenceReader.getSeqLen(targetKey);
+                    const char *targetSeqData = targetSequenceReader.getData(targetKey, thread_idx);
+                    targetSeq.mapSequence(targetKey, targetKey, targetSeqData, targetSeqLen);
+                    alignTargetCandidates(&context, thread_idx, targetKey, targetSeqData, targetSeq.L, targetSeqLen, targetCandidates);
+                }
+                std::vector<UngappedCandidate>().swap(targetCandidates);
+            }
+        }
 
-        for (size_t i = 0; i < results.size(); ++i) {
-            results[i].dbOrfStartPos = (int) results[i].dbKey;
-            results[i].dbKey = (unsigned int) results[i].queryOrfStartPos;
-            Matcher::result_t::swapResult(results[i], evaluer, true);
-            size_t len = Matcher::resultToBuffer(buffer, results[i], par.addBacktrace, true, true);
-            writer.writeData(buffer, len, results[i].dbKey, thread_idx);
+        // the implicit barrier of the loop waits for all work items, so every result is in one of the workers
+        AlignWorker *worker = workers[thread_idx];
+        // merges the runs spilled under the memory limit, results come out sorted by query
+        worker->results.finish();
+        if (worker->results.getRunCount() > 0) {
+            Debug(Debug::INFO) << "Thread " << thread_idx << " merges " << worker->results.getRunCount() << " spilled result runs\n";
         }
-        results.clear();
+        Matcher::result_t res;
+        while (worker->results.next(res)) {
+            res.dbOrfStartPos = (int) res.dbKey;
+            res.dbKey = (unsigned int) res.queryOrfStartPos;
+            Matcher::result_t::swapResult(res, evaluer, true);
+            // the backtrace is compressed already
+            size_t len = Matcher::resultToBuffer(buffer, res, par.addBacktrace, false, true);
+            writer.writeData(buffer, len, res.dbKey, thread_idx);
+        }
+        alignmentsNum += worker->alignmentsNum;
+        totalPassedNum += worker->totalPassedNum;
+        zeroLengthSeqs += worker->zeroLengthSeqs;
+        queryCacheHits += worker->queryCache.getHits();
+        queryCacheLookups += worker->queryCache.getLookups();
+        delete worker;
+        delete reducedSeq;
     }
 
 //#pragma omp parallel
@@ -464,7 +880,13 @@ int blockalign(int argc, const char **argv, const Command &command) {
 
     Debug(Debug::INFO) << kmerMatch << " before diagonal filter\n";
     Debug(Debug::INFO) << ungappedNum << " ungapped alignments calculated\n";
+    if (rankCandidates) {
+        Debug(Debug::INFO) << rankDroppedNum << " candidates beyond the best " << par.maxAlignedSeqs << " of their query skipped\n";
+    }
     Debug(Debug::INFO) << alignmentsNum << " alignments calculated\n";
+    if (queryCacheLookups > 0) {
+        Debug(Debug::INFO) << queryCacheHits << " of " << queryCacheLookups << " query lookups served by the query cache\n";
+    }
     Debug(Debug::INFO) << totalPassedNum << " sequence pairs passed the thresholds";
     if (alignmentsNum > 0) {
         Debug(Debug::INFO) << " (" << ((float) totalPassedNum / (float) alignmentsNum) << " of overall calculated)";
@@ -487,6 +909,9 @@ int blockalign(int argc, const char **argv, const Command &command) {
 
     delete[] fastMatrix.matrixData;
     delete[] fastMatrix.matrix;
+    if (kmerMat != subMat) {
+        delete kmerMat;
+    }
     delete subMat;
     subMat = nullptr;
     return EXIT_SUCCESS;
@@ -3,8 +3,13 @@
 #include "NucleotideMatrix.h"
 #include "ExtendedSubstitutionMatrix.h"
 #include "Indexer.h"
+#include "KmerIndex.h"
+#include "KmerSampling.h"
 #include "KmerGenerator.h"
 #include "FixedKmerGenerator.h"
+#include "CompressedQueryTable.h"
+#include "TargetTableReader.h"
+#include "HotKmerPostings.h"
 #include "MathUtil.h"
 #include "QueryTableEntry.h"
 #include "DBWriter.h"
@@ -14,6 +19,7 @@
 #include "tantan.h"
 
 #include <map>
+#include <functional>
 #include <fcntl.h>  // open, read
 #include <unistd.h>
 #include <cstdlib> // aligned_alloc
@@ -24,41 +30,21 @@
 #include <omp.h>
 #endif
 
-#define MEM_SIZE_16MB ((size_t) (16 * 1024 * 1024))
-#define MEM_SIZE_32MB ((size_t) (32 * 1024 * 1024))
-
-QueryTableEntry *copyHitSequences(
-    QueryTableEntry *startPos, QueryTableEntry *endPos, QueryTableEntry *destPos
-) {
-    QueryTableEntry *currentReadPos = startPos;
-    QueryTableEntry *currentWritePos = destPos;
-    while (currentReadPos < endPos) {
-        if (currentReadPos->targetSequenceID != UINT_MAX) {
-            // If this entry had a hit, we copy it to the destination location
-            memcpy(currentWritePos, currentReadPos, sizeof(QueryTableEntry));
-            ++currentWritePos;
-        }
-        ++currentReadPos;
-    }
-    return currentWritePos;
-}
-
-QueryTableEntry *removeNotHitSequences(
-    QueryTableEntry *startPos, QueryTableEntry *endPos, unsigned int requiredKmerMatches
-) {
-    QueryTableEntry *currentReadPos = startPos;
-    QueryTableEntry *currentWritePos = startPos;
+template <typename Entry>
+Entry *removeNotHitSequences(Entry *startPos, Entry *endPos, unsigned int requiredKmerMatches) {
+    Entry *currentReadPos = startPos;
+    Entry *currentWritePos = startPos;
     while (currentReadPos < endPos) {
         size_t count = 1;
         while (currentReadPos < endPos - 1
-               && currentReadPos->targetSequenceID != UINT_MAX
+               && currentReadPos->targetSequenceID != Entry::NO_TARGET_ID
                && currentReadPos->targetSequenceID == (currentReadPos + 1)->targetSequenceID
                && currentReadPos->querySequenceId == (currentReadPos + 1)->querySequenceId) {
             ++count;
             ++currentReadPos;
         }
         if (count > requiredKmerMatches) {
-            memcpy(currentWritePos, currentReadPos - (count - 1), sizeof(QueryTableEntry) * count);
+            memcpy(currentWritePos, currentReadPos - (count - 1), sizeof(Entry) * count);
             currentWritePos += count;
         }
         ++currentReadPos;
@@ -67,34 +53,8 @@ QueryTableEntry *removeNotHitSequences(
 }
 
 
-inline void parallelReadIntoVec(
-    int fd,
-    std::vector<void *> &destBlocks,
-    std::vector<ssize_t> &destBlockSize,
-    size_t blockSize,
-    bool allocateNewSpace = true,
-    size_t offsetBlock = 0
-) {
-    size_t end = destBlocks.size();
-// #pragma omp parallel for schedule(dynamic, 10)
-    for (size_t j = 0; j < end; j++) {
-        // TODO: determine the alignment dynamically instead of using hard-coded 512
-        if (allocateNewSpace) {
-            destBlocks[j] = aligned_alloc(512, blockSize);
-            if (destBlocks[j] == nullptr) {
-                Debug(Debug::ERROR) << "Cannot allocate memory for target table\n";
-                EXIT(EXIT_FAILURE);
-            }
-        }
-        off_t offset = (off_t) ((offsetBlock * end + j) * blockSize);
-        if ((destBlockSize[j] = pread(fd, destBlocks[j], blockSize, offset)) < 0) {
-            Debug(Debug::ERROR) << "Cannot read chunk #" << (j + 1) << " from target table\n";
-            EXIT(EXIT_FAILURE);
-        }
-    }
-}
-
-int resultTableSort(const QueryTableEntry &first, const QueryTableEntry &second) {
+template <typename Entry>
+int resultTableSort(const Entry &first, const Entry &second) {
     if (first.targetSequenceID != second.targetSequenceID) {
         return first.targetSequenceID < second.targetSequenceID;
     }
@@ -110,7 +70,8 @@ int resultTableSort(const QueryTableEntry &first, const QueryTableEntry &second)
     return false;
 }
 
-int queryTableSort(const QueryTableEntry &first, const QueryTableEntry &second) {
+template <typename Entry>
+int queryTableSort(const Entry &first, const Entry &second) {
     if (first.Query.kmer != second.Query.kmer) {
         return first.Query.kmer < second.Query.kmer;
     }
@@ -123,19 +84,65 @@ int queryTableSort(const QueryTableEntry &first, const QueryTableEntry &second)
     return false;
 }
 
-void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryTable) {
+struct SensitivitySetting {
+    int kmerScore;
+    unsigned int maxKmerPerPos;
+    // appended to the result DB name, empty for the setting given by --k-score and --max-kmer-per-pos
+    std::string suffix;
+
+    template <typename Entry>
+    bool accepts(const Entry &entry) const {
+        return getKmerScore(entry) >= kmerScore && getKmerRank(entry) < maxKmerPerPos;
+    }
+};
+
+std::vector<SensitivitySetting> parseSensitivitySweep(const std::string &sweep) {
+    std::vector<SensitivitySetting> settings;
+    if (sweep.empty()) {
+        return settings;
+    }
+    std::vector<std::string> pairs = Util::split(sweep, ",");
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        std::vector<std::string> values = Util::split(pairs[i], ":");
+        if (values.size() != 2) {
+            Debug(Debug::ERROR) << "Invalid sensitivity sweep entry " << pairs[i] << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+        SensitivitySetting setting;
+        setting.kmerScore = Util::fast_atoi<int>(values[0].c_str());
+        setting.maxKmerPerPos = Util::fast_atoi<unsigned int>(values[1].c_str());
+        setting.suffix = "_" + values[0] + "_" + values[1];
+        settings.emplace_back(setting);
+    }
+    return settings;
+}
+
+/**
+ * @brief Appends the similar k-mers of all sequences of queryDB to the (unsorted) query table
+ * With a non-empty sweep, the k-mers of the least strict setting of the sweep and the primary setting are generated
+ * and each ScoredQueryTableEntry carries its score and rank, so that every setting can be selected from the same table later.
+ * keyOffset is added to the query keys to tell several query DBs in the same table apart.
+ * @return the number of keys used by queryDB (largest key + 1)
+ */
+template <typename Entry>
+size_t createQueryTable(LocalParameters &par, const std::string &queryDB, std::vector<Entry> &queryTable,
+                        const std::vector<SensitivitySetting> &sweep, unsigned int keyOffset) {
     Timer timer;
 
-    int seqType = FileUtil::parseDbType(par.db1.c_str());
+    int seqType = FileUtil::parseDbType(queryDB.c_str());
 
     const bool useProfileSearch = Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_HMM_PROFILE);
 
     BaseMatrix *subMat;
     if (Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_NUCLEOTIDES)) {
-        subMat = new NucleotideMatrix(par.seedScoringMatrixFile.values.nucleotide().c_str(), 1.0, 0.0);
+        subMat = SRAUtil::getKmerMatrix(par, true, 1.0, 0.0);
     } else if (Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_AMINO_ACIDS)) {
-        subMat = new SubstitutionMatrix(par.seedScoringMatrixFile.values.aminoacid().c_str(), 8.0, -0.2f);
+        subMat = SRAUtil::getKmerMatrix(par, false, 8.0, -0.2f);
     } else if (useProfileSearch) {
+        if (par.alphabetSize.values.aminoacid() < 21) {
+            Debug(Debug::ERROR) << "Reduced alphabets are not supported for profile queries\n";
+            EXIT(EXIT_FAILURE);
+        }
         subMat = new SubstitutionMatrix(par.seedScoringMatrixFile.values.aminoacid().c_str(), 2.0f, 0.0);
     } else {
         Debug(Debug::ERROR) << "Invalid input type (Support: nucleotide, amino acid, profile)\n";
@@ -143,7 +150,7 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
     }
 
     DBReader<unsigned int> reader(
-        par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA
+        queryDB.c_str(), (queryDB + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA
     );
     reader.open(DBReader<unsigned int>::LINEAR_ACCCESS);
     Debug(Debug::INFO) << "Input preparation time: " << timer.lap() << "\n";
@@ -155,8 +162,12 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
     // double similarKmerFactor = 1.5 * (useProfileSearch ? 5 : 1);
     // size_t tableCapacity = (size_t) (similarKmerFactor * (double) (kmerCount + 1));
     const size_t kmerCount = reader.getAminoAcidDBSize() - (reader.getSize() * (par.kmerSize + 1));
-    const size_t tableCapacity = (size_t) (par.maxKmerPerPos * (kmerCount + 1));
-    queryTable.reserve(tableCapacity);
+    int maxKmerPerPos = par.maxKmerPerPos;
+    for (size_t i = 0; i < sweep.size(); ++i) {
+        maxKmerPerPos = std::max(maxKmerPerPos, (int) sweep[i].maxKmerPerPos);
+    }
+    const size_t tableCapacity = (size_t) (maxKmerPerPos * (kmerCount + 1));
+    queryTable.reserve(queryTable.size() + tableCapacity);
 
     const int xIndex = subMat->aa2num[(int) 'X'];
 
@@ -173,7 +184,7 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
     const unsigned int total_threads = par.threads;
 
     Debug::Progress progress(reader.getSize());
-#pragma omp parallel default(none) shared(par, reader, subMat, progress, seqType, twoMatrix, threeMatrix, tableCapacity, queryTable, useProfileSearch, probMatrix) firstprivate(xIndex, kmerSize, total_threads)
+#pragma omp parallel default(none) shared(par, reader, subMat, progress, seqType, twoMatrix, threeMatrix, tableCapacity, queryTable, useProfileSearch, probMatrix, sweep) firstprivate(xIndex, kmerSize, total_threads, maxKmerPerPos, keyOffset)
     {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
@@ -182,8 +193,13 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
         Indexer idx(subMat->alphabetSize - 1, kmerSize);
         Sequence sequence(par.maxSeqLen, seqType, subMat, kmerSize, par.spacedKmer, par.compBiasCorrection, useProfileSearch ? false : true, par.spacedKmerPattern);
 
-        const int kmerThr = useProfileSearch ? par.kmerScore.values.profile() : par.kmerScore.values.sequence();
-        FixedKmerGenerator kmerGenerator(kmerSize, subMat->alphabetSize - 1, kmerThr, par.maxKmerPerPos);
+        int kmerThr = useProfileSearch ? par.kmerScore.values.profile() : par.kmerScore.values.sequence();
+        for (size_t i = 0; i < sweep.size(); ++i) {
+            kmerThr = std::min(kmerThr, sweep[i].kmerScore);
+        }
+        // syncmer tables only contain syncmers, minimizer tables can contain any k-mer
+        const bool syncmersOnly = par.kmerSampling == KmerSampling::SYNCMER;
+        FixedKmerGenerator kmerGenerator(kmerSize, subMat->alphabetSize - 1, kmerThr, maxKmerPerPos);
 
         if (useProfileSearch && sequence.profile_matrix != nullptr) {
             kmerGenerator.setDivideStrategy(sequence.profile_matrix);
@@ -191,7 +207,7 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
             kmerGenerator.setDivideStrategy(&threeMatrix, &twoMatrix);
         }
 
-        std::vector<QueryTableEntry> localTable;
+        std::vector<Entry> localTable;
         localTable.reserve(tableCapacity / total_threads);
 
         float *compositionBias = nullptr;
@@ -206,6 +222,7 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
             char *data = reader.getData(i, (int) thread_idx);
             unsigned int seqLen = reader.getSeqLen(i);
             sequence.mapSequence(i, key, data, seqLen);
+            key += keyOffset;
 
             if (par.compBiasCorrection == 1) {
                 SubstitutionMatrix::calcLocalAaBiasCorrection(subMat, sequence.numSequence, sequence.L, compositionBias, par.compBiasCorrectionScale);
@@ -236,6 +253,7 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
                     continue;
                 }
 
+                short bias = 0;
                 if (par.compBiasCorrection == 1) {
                     const unsigned char *pos = sequence.getAAPosInSpacedPattern();
                     const unsigned short current_i = sequence.getCurrentPosition();
@@ -243,7 +261,7 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
                     for (unsigned int i = 0; i < kmerSize; i++) {
                         biasCorrection += compositionBias[current_i + static_cast<short>(pos[i])];
                     }
-                    short bias = std::min((short)0, static_cast<short>((biasCorrection < 0.0) ? biasCorrection - 0.5 : biasCorrection + 0.5));
+                    bias = std::min((short)0, static_cast<short>((biasCorrection < 0.0) ? biasCorrection - 0.5 : biasCorrection + 0.5));
                     short kmerMatchScore = std::max(kmerThr - bias, 0);
 
                     // Debug(Debug::ERROR) << "bias: " << bias << " kmerMatchScore: " << kmerMatchScore << "\n";
@@ -252,23 +270,37 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
                     kmerGenerator.setThreshold(kmerMatchScore);
                 }
 
-                QueryTableEntry entry{};
+                Entry entry{};
                 entry.querySequenceId = key;
-                entry.targetSequenceID = UINT_MAX;
-                entry.Query.kmer = idx.int2index(kmer, 0, kmerSize);
+                entry.targetSequenceID = Entry::NO_TARGET_ID;
+                entry.Query.kmer = kmerIndex(kmer, idx.powers, kmerSize);
                 // idx.printKmer(entry.Query.kmer, kmerSize, subMat->num2aa);
                 // Debug(Debug::INFO) << "\n";
                 entry.Query.kmerPosInQuery = sequence.getCurrentPosition();
-                localTable.emplace_back(entry);
+                // the exact k-mer is part of every setting
+                setKmerScore(entry, SHRT_MAX, 0);
+                if (syncmersOnly == false || KmerSampling::isSyncmer(entry.Query.kmer, idx.powers, kmerSize, par.kmerSamplingWindow)) {
+                    localTable.emplace_back(entry);
+                }
                 if (par.exactKmerMatching == false) {
                     std::pair<size_t *, size_t> similarKmerList = kmerGenerator.generateKmerList(kmer); // , false, par.maxKmerPerPos);
+                    const short *similarKmerScores = kmerGenerator.getKmerScores();
                     for (size_t j = 0; j < similarKmerList.second; ++j) {
+                        if (syncmersOnly && KmerSampling::isSyncmer(similarKmerList.first[j], idx.powers, kmerSize, par.kmerSamplingWindow) == false) {
+                            continue;
+                        }
                         entry.querySequenceId = key;
-                        entry.targetSequenceID = UINT_MAX;
+                        entry.targetSequenceID = Entry::NO_TARGET_ID;
                         entry.Query.kmer = similarKmerList.first[j];
                         // idx.printKmer(entry.Query.kmer, kmerSize, subMat->num2aa);
                         // Debug(Debug::INFO) << "\n";
                         entry.Query.kmerPosInQuery = sequence.getCurrentPosition();
+                        // a setting with k-score t accepted this k-mer if score >= t - bias, the bias is never positive
+                        setKmerScore(
+                            entry,
+                            (short) std::max(similarKmerScores[j] + bias, SHRT_MIN),
+                            (unsigned short) std::min(j, (size_t) USHRT_MAX)
+                        );
                         localTable.emplace_back(entry);
                     }
                 }
@@ -284,12 +316,10 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
     }
     Debug(Debug::INFO) << "\nk-mers: " << queryTable.size()
                        << "\nk-mers per pos: " << (double) queryTable.size() / (double) reader.getAminoAcidDBSize()
-                       << "\nRequired Memory: " << queryTable.size() * sizeof(QueryTableEntry) / 1024 / 1024 << " MB"
+                       << "\nRequired Memory: " << queryTable.size() * sizeof(Entry) / 1024 / 1024 << " MB"
                        << "\ntime: " << timer.lap() << "\n";
 
-    timer.reset();
-    SORT_PARALLEL(queryTable.begin(), queryTable.end(), queryTableSort);
-    Debug(Debug::INFO) << "Sorting time: " << timer.lap() << "\n";
+    const size_t keyCount = reader.getSize() > 0 ? (size_t) reader.getLastKey() + 1 : 0;
 
     delete subMat;
     subMat = nullptr;
@@ -299,6 +329,7 @@ void createQueryTable(LocalParameters &par, std::vector<QueryTableEntry> &queryT
         ExtendedSubstitutionMatrix::freeScoreMatrix(threeMatrix);
     }
     reader.close();
+    return keyCount;
 }
 
 std::vector<size_t> roundRobinOrder(const std::vector<std::string>& filenames) {
@@ -343,307 +374,678 @@ void reorderVectorInPlace(std::vector<T>& original, const std::vector<size_t>& i
 }
 
 
-int comparekmertables(int argc, const char **argv, const Command &command) {
-    LocalParameters &par = LocalParameters::getLocalInstance();
-    par.spacedKmer = false;
+template <typename Entry>
+class QueryTableCursor {
+public:
+    explicit QueryTableCursor(const std::vector<Entry> &table) : table(table.data()), pos(0), end(table.size()) {}
 
-    par.parseParameters(argc, argv, command, true, 0, LocalParameters::PARSE_VARIADIC);
+    bool atEnd() const {
+        return pos >= end;
+    }
 
-    std::vector<QueryTableEntry> qTable;
-    createQueryTable(par, qTable);
+    unsigned long long kmer() const {
+        return table[pos].Query.kmer;
+    }
 
-    // FIXME: accept single file input also
-    std::vector<std::string> targetTables = SRAUtil::getFileNamesFromFile(par.db2);
-    std::vector<std::string> resultFiles = SRAUtil::getFileNamesFromFile(par.db3);
-    if (targetTables.empty()) {
-        Debug(Debug::ERROR) << "Expected at least one targetTable entry in the target table file\n";
-        EXIT(EXIT_FAILURE);
+    size_t index() const {
+        return pos;
     }
-    if (targetTables.size() != resultFiles.size()) {
-        Debug(Debug::ERROR) << "Number of targetTable and result table is not equal\n";
-        EXIT(EXIT_FAILURE);
+
+    void advance() {
+        ++pos;
     }
 
-    std::vector<size_t> indices = roundRobinOrder(targetTables);
-    reorderVectorInPlace(targetTables, indices);
-    reorderVectorInPlace(resultFiles, indices);
+    void seek(unsigned long long kmer) {
+        while (LIKELY(pos < end) && table[pos].Query.kmer < kmer) {
+            ++pos;
+        }
+    }
 
-    const unsigned long queryTableSize = qTable.size() * sizeof(QueryTableEntry);
-    const size_t numQTableAvailInMem = Util::getTotalSystemMemory() / 3 / queryTableSize;
-    // const size_t chunkSize = numQTableAvailInMem >= targetTables.size() ? 1 : targetTables.size() / numQTableAvailInMem;
+    Entry getEntry(size_t i, unsigned long long, uint64_t targetId) const {
+        Entry entry = table[i];
+        entry.targetSequenceID = targetId;
+        return entry;
+    }
 
-    const unsigned long MAXIMUM_NUM_OF_BLOCKS =
-            (Util::getTotalSystemMemory() - numQTableAvailInMem * queryTableSize) / (MEM_SIZE_16MB + MEM_SIZE_32MB);
-    const unsigned long maximumNumOfBlocksPerDB = MAXIMUM_NUM_OF_BLOCKS / targetTables.size();
+private:
+    const Entry *table;
+    size_t pos;
+    size_t end;
+};
+
+template <typename Entry>
+class CompressedQueryTableCursor {
+public:
+    explicit CompressedQueryTableCursor(const CompressedQueryTable &table) : table(table) {
+        loadBlock(0);
+    }
 
-    size_t localThreads = par.threads;
-#ifdef OPENMP
-    localThreads = std::max(std::min(localThreads, targetTables.size()), (size_t)1);
-#endif
+    bool atEnd() const {
+        return block >= table.blockCount();
+    }
 
-#pragma omp parallel num_threads(localThreads) default(none) shared(par, resultFiles, qTable, targetTables, std::cerr, std::cout, maximumNumOfBlocksPerDB)
-    {
-        Timer timer;
-        QueryTableEntry* localQTable = new QueryTableEntry[qTable.size()];
-        std::memcpy(localQTable, qTable.data(), qTable.size() * sizeof(QueryTableEntry));
-        Debug(Debug::INFO) << "Deep copy time: " << timer.lap() << "\n";
+    unsigned long long kmer() const {
+        return kmers[posInBlock];
+    }
 
-        QueryTableEntry* resultTable = new QueryTableEntry[qTable.size()];
+    size_t index() const {
+        return blockStart + posInBlock;
+    }
 
-        std::string result;
-        result.reserve(10 * 1024 * 1024);
-        char buffer[1024];
+    void advance() {
+        ++posInBlock;
+        if (UNLIKELY(posInBlock >= blockEntries)) {
+            loadBlock(block + 1);
+        }
+    }
 
-#pragma omp for schedule(dynamic, 1)
-        for (size_t i = 0; i < targetTables.size(); ++i) {
-            // std::vector<QueryTableEntry> localQTable(qTable); //creates a deep copy of the queryTable
-            QueryTableEntry *startPosQueryTable = localQTable;
-            QueryTableEntry *endQueryPos = startPosQueryTable + qTable.size();
+    void seek(unsigned long long kmer) {
+        // skip whole blocks without decoding them if the following block still starts below the k-mer
+        size_t next = block;
+        while (next + 1 < table.blockCount() && table.getBlockFirstKmer(next + 1) < kmer) {
+            ++next;
+        }
+        if (next != block) {
+            loadBlock(next);
+        }
+        while (LIKELY(atEnd() == false) && kmers[posInBlock] < kmer) {
+            advance();
+        }
+    }
 
-            const std::string& targetName = targetTables[i];
+    Entry getEntry(size_t i, unsigned long long kmer, uint64_t targetId) const {
+        return table.getEntry<Entry>(i, kmer, targetId);
+    }
 
-            timer.reset();
-#if !defined(O_DIRECT)
-            const int mode = (O_RDONLY | O_SYNC);
-#else
-            const int mode = (O_RDONLY | O_DIRECT | O_SYNC);
-#endif
-            /* Open target table in direct mode */
-            int fdTargetTable = open(targetName.c_str(), mode);
-            if (fdTargetTable < 0) {
-                Debug(Debug::ERROR) << "Open target table " << targetName << " failed\n";
-                EXIT(EXIT_FAILURE);
+private:
+    const CompressedQueryTable &table;
+    size_t block;
+    size_t blockStart;
+    size_t blockEntries;
+    size_t posInBlock;
+    unsigned long long kmers[CompressedQueryTable::BLOCK_SIZE];
+
+    void loadBlock(size_t b) {
+        block = b;
+        posInBlock = 0;
+        blockStart = std::min(b * CompressedQueryTable::BLOCK_SIZE, table.size());
+        blockEntries = b < table.blockCount() ? table.decodeBlock(b, kmers) : 0;
+    }
+};
+
+/**
+ * @brief Merge join of a sorted query table with a target table
+ * Every query entry sharing a k-mer with the target table is appended to hits with the target id set.
+ * @return the number of target entries that matched at least one query entry
+ */
+template <typename Cursor, typename Entry>
+size_t joinTargetTable(Cursor &query, TargetTableReader &target, std::vector<Entry> &hits) {
+    size_t equalKmers = 0;
+    size_t groupStart = 0;
+    size_t groupEnd = 0;
+    unsigned long long groupKmer = 0;
+    bool hasGroup = false;
+    while (target.next()) {
+        const unsigned long long kmer = target.getKmer();
+        if (hasGroup == false || kmer != groupKmer) {
+            query.seek(kmer);
+            if (UNLIKELY(query.atEnd())) {
+                break;
             }
-#if !defined(O_DIRECT) && defined(F_NOCACHE)
-            fcntl(fdTargetTable, F_NOCACHE, 1);
-#endif
+            if (query.kmer() != kmer) {
+                hasGroup = false;
+                continue;
+            }
+            groupStart = query.index();
+            groupKmer = kmer;
+            while (LIKELY(query.atEnd() == false) && query.kmer() == kmer) {
+                query.advance();
+            }
+            groupEnd = query.index();
+            hasGroup = true;
+        }
+        ++equalKmers;
+        const uint64_t targetId = target.getId();
+        for (size_t i = groupStart; i < groupEnd; ++i) {
+            hits.emplace_back(query.getEntry(i, kmer, targetId));
+        }
+    }
+    return equalKmers;
+}
+
+/**
+ * @brief Merge join of a sorted query table with several target tables at once
+ * The query table is walked a single time, the target tables are merged by k-mer like in a k-way merge.
+ * Hits of targets[t] are appended to hits[t] in the same order as joinTargetTable would produce them.
+ * @return the number of matching target entries per target table
+ */
+template <typename Cursor, typename Entry>
+std::vector<size_t> joinTargetTables(Cursor &query, std::vector<TargetTableReader *> &targets, std::vector<std::vector<Entry>> &hits) {
+    std::vector<size_t> equalKmers(targets.size(), 0);
+    // min-heap of (current k-mer, target index)
+    std::vector<std::pair<unsigned long long, size_t>> heap;
+    std::greater<std::pair<unsigned long long, size_t>> heapOrder;
+    for (size_t t = 0; t < targets.size(); ++t) {
+        if (targets[t]->next()) {
+            heap.emplace_back(targets[t]->getKmer(), t);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), heapOrder);
+
+    std::vector<size_t> groupTargets;
+    while (heap.empty() == false) {
+        const unsigned long long kmer = heap.front().first;
+        query.seek(kmer);
+        if (UNLIKELY(query.atEnd())) {
+            break;
+        }
+        const unsigned long long queryKmer = query.kmer();
+
+        // take every target whose current k-mer is below the next query k-mer
+        groupTargets.clear();
+        while (heap.empty() == false && heap.front().first <= queryKmer) {
+            std::pop_heap(heap.begin(), heap.end(), heapOrder);
+            groupTargets.emplace_back(heap.back().second);
+            heap.pop_back();
+        }
 
-            /* Open ID table in direct mode */
-            int fdIDTable = open((targetName + "_ids").c_str(), mode);
-            if (fdIDTable < 0) {
-                Debug(Debug::ERROR) << "Open ID table " << targetName << "_ids" << "failed\n";
-                EXIT(EXIT_FAILURE);
+        if (queryKmer != kmer) {
+            // no query entries for these k-mers, skip ahead in the target tables
+            for (size_t g = 0; g < groupTargets.size(); ++g) {
+                TargetTableReader *target = targets[groupTargets[g]];
+                bool hasNext = true;
+                while (target->getKmer() < queryKmer && (hasNext = target->next())) {}
+                if (hasNext) {
+                    heap.emplace_back(target->getKmer(), groupTargets[g]);
+                    std::push_heap(heap.begin(), heap.end(), heapOrder);
+                }
             }
-#if !defined(O_DIRECT) && defined(F_NOCACHE)
-            fcntl(fdIDTable, F_NOCACHE, 1);
-#endif
+            continue;
+        }
 
-            /* Get file size in bytes */
-            size_t targetTableSize = FileUtil::getFileSize(targetName);
-            size_t idTableSize = FileUtil::getFileSize((targetName + "_ids"));
+        const size_t groupStart = query.index();
+        while (LIKELY(query.atEnd() == false) && query.kmer() == kmer) {
+            query.advance();
+        }
+        const size_t groupEnd = query.index();
+        for (size_t g = 0; g < groupTargets.size(); ++g) {
+            const size_t t = groupTargets[g];
+            TargetTableReader *target = targets[t];
+            bool hasNext = true;
+            while (hasNext && target->getKmer() == kmer) {
+                ++equalKmers[t];
+                const uint64_t targetId = target->getId();
+                for (size_t i = groupStart; i < groupEnd; ++i) {
+                    hits[t].emplace_back(query.getEntry(i, kmer, targetId));
+                }
+                hasNext = target->next();
+            }
+            if (hasNext) {
+                heap.emplace_back(target->getKmer(), t);
+                std::push_heap(heap.begin(), heap.end(), heapOrder);
+            }
+        }
+    }
+    return equalKmers;
+}
 
-            size_t totalNumOfTargetBlocks = targetTableSize / MEM_SIZE_16MB + (targetTableSize % MEM_SIZE_16MB == 0 ? 0 : 1);
-            size_t totalNumOfIDBlocks = idTableSize / MEM_SIZE_32MB + (idTableSize % MEM_SIZE_32MB == 0 ? 0 : 1);
+// query entries [groupStart, groupEnd) share the k-mer of hot k-mer hotKmer, they hit every ID of its ID set
+struct HotKmerHit {
+    size_t groupStart;
+    size_t groupEnd;
+    size_t hotKmer;
+};
+
+/**
+ * @brief Join of a sorted query table with the hot k-mers of a merged target table
+ * The hits are kept as query entry range and hot k-mer, they are only expanded to one entry per ID
+ * target by target in writeTargetTableResults.
+ * @return the number of target IDs that matched at least one query entry
+ */
+template <typename Cursor>
+size_t joinHotKmers(Cursor &query, const HotKmerPostings &hotKmers, std::vector<HotKmerHit> &hits) {
+    size_t equalKmers = 0;
+    for (size_t k = 0; k < hotKmers.size(); ++k) {
+        const unsigned long long kmer = hotKmers.getKmer(k);
+        query.seek(kmer);
+        if (UNLIKELY(query.atEnd())) {
+            break;
+        }
+        if (query.kmer() != kmer) {
+            continue;
+        }
+        HotKmerHit hit;
+        hit.groupStart = query.index();
+        while (LIKELY(query.atEnd() == false) && query.kmer() == kmer) {
+            query.advance();
+        }
+        hit.groupEnd = query.index();
+        hit.hotKmer = k;
+        hits.emplace_back(hit);
+        equalKmers += hotKmers.getIdCount(k);
+    }
+    return equalKmers;
+}
 
-            size_t numOfTargetBlocks = std::min(maximumNumOfBlocksPerDB, totalNumOfTargetBlocks);
-            size_t numOfIDBlocks = std::min(maximumNumOfBlocksPerDB, totalNumOfIDBlocks);
+/**
+ * @brief Result DB that is written one target at a time in ascending target order
+ * The last entry of a target is not written, a target with a single entry gets an empty result,
+ * unless it is the last target of the DB.
+ */
+class ResultDBStream {
+public:
+    ResultDBStream(const std::string &resultDB, int compressed)
+        : writer(resultDB.c_str(), (resultDB + ".index").c_str(), 1, compressed, Parameters::DBTYPE_PREFILTER_RES),
+          hasPendingKey(false), pendingKey(0), entries(0), keptEntries(0) {
+        writer.open();
+    }
 
-            std::vector<void *> targetTableBlocks(numOfTargetBlocks);
-            std::vector<ssize_t> targetTableBlockSize(numOfTargetBlocks, -1);
-            std::vector<void *> IDTableBlocks(numOfIDBlocks);
-            std::vector<ssize_t> IDTableBlockSize(numOfIDBlocks, -1);
+    // entries of a single target, sorted by resultTableSort and reduced by removeNotHitSequences
+    template <typename Entry>
+    void writeTarget(const Entry *begin, const Entry *end, std::string &buffer) {
+        if (begin == end) {
+            return;
+        }
+        if (hasPendingKey) {
+            writer.writeData("", 0, pendingKey, 0);
+            hasPendingKey = false;
+        }
+        // IDs of merged tables were made relative to their source table before, mergekmertables only accepts
+        // source tables with 32-bit IDs
+        const unsigned int key = (unsigned int) begin->targetSequenceID;
+        if (end - begin == 1) {
+            hasPendingKey = true;
+            pendingKey = key;
+            return;
+        }
+        char line[1024];
+        buffer.clear();
+        for (const Entry *entry = begin; entry < end - 1; ++entry) {
+            const size_t len = QueryTableEntry::queryEntryToBuffer(line, *entry);
+            buffer.append(line, len);
+        }
+        writer.writeData(buffer.c_str(), buffer.length(), key, 0);
+    }
 
-            /* Read in 16MB chunks for target table */
-            parallelReadIntoVec(fdTargetTable, targetTableBlocks, targetTableBlockSize, MEM_SIZE_16MB);
+    void countEntries(size_t count, size_t keptCount) {
+        entries += count;
+        keptEntries += keptCount;
+    }
 
-            /* Read in 32MB chunks for ID table */
-            parallelReadIntoVec(fdIDTable, IDTableBlocks, IDTableBlockSize, MEM_SIZE_32MB);
+    size_t getEntries() const {
+        return entries;
+    }
 
-            size_t IDTableIndex = 0;
-            size_t IDReadGroup = 0;
+    size_t getKeptEntries() const {
+        return keptEntries;
+    }
 
-            unsigned int *startPosIDTable, *currentIDPos, *endIDPos;
-            startPosIDTable = (unsigned int *) IDTableBlocks[IDTableIndex];
-            currentIDPos = startPosIDTable;
-            endIDPos = startPosIDTable + (MEM_SIZE_32MB / sizeof(unsigned int));
+    void close() {
+        writer.close();
+    }
 
-            QueryTableEntry *currentQueryPos = startPosQueryTable;
-            QueryTableEntry *endPosQueryTable = startPosQueryTable;
+private:
+    DBWriter writer;
+    bool hasPendingKey;
+    unsigned int pendingKey;
+    size_t entries;
+    size_t keptEntries;
+};
+
+/**
+ * @brief Writes the hits of one target table target by target
+ * Each target's entries are routed to the result DB of their source table (merged tables, resultDB_db<N>),
+ * query set (--query-db-list, resultDB_set<q> with the original query keys) and sensitivity setting
+ * (--sensitivity-sweep, resultDB + suffix). hits has to be sorted by resultTableSort, hot k-mer hits are expanded
+ * for one target at a time, so they never have to be materialized for the whole table.
+ */
+template <typename Entry, typename Cursor>
+void writeTargetTableResults(
+    const LocalParameters &par, const std::vector<SensitivitySetting> &sweep, const std::vector<size_t> &querySetOffsets,
+    const std::string &resultDB, const std::vector<uint64_t> &targetOffsets, std::vector<Entry> &hits,
+    const std::vector<HotKmerHit> &hotHits, const HotKmerPostings &hotKmers, const Cursor &query
+) {
+    // a table that was not merged is a single source with offset 0 and without the _db suffix
+    const std::vector<uint64_t> sourceOffsets = targetOffsets.empty() ? std::vector<uint64_t>(1, 0) : targetOffsets;
+    const size_t querySets = querySetOffsets.size() - 1;
+    const size_t settings = std::max(sweep.size(), (size_t) 1);
+    std::vector<ResultDBStream *> streams(querySets * settings, NULL);
+    size_t source = 0;
+    bool sourceOpen = false;
+
+    std::string buffer;
+    std::vector<Entry> targetHits;
+    std::vector<Entry> settingHits;
+
+    auto openSource = [&](size_t db) {
+        const std::string sourceResultDB = targetOffsets.empty() ? resultDB : resultDB + "_db" + SSTR(db);
+        for (size_t q = 0; q < querySets; ++q) {
+            const std::string setResultDB = q == 0 ? sourceResultDB : sourceResultDB + "_set" + SSTR(q);
+            for (size_t s = 0; s < settings; ++s) {
+                streams[q * settings + s] = new ResultDBStream(setResultDB + (sweep.empty() ? "" : sweep[s].suffix), par.compressed);
+            }
+        }
+    };
+    auto closeSource = [&]() {
+        for (size_t i = 0; i < streams.size(); ++i) {
+            const std::string setting = sweep.empty() ? "" : SSTR(sweep[i % settings].kmerScore) + ":" + SSTR(sweep[i % settings].maxKmerPerPos) + " ";
+            Debug(Debug::INFO) << "Reduced k-mers " << setting << streams[i]->getEntries() << " -> " << streams[i]->getKeptEntries() << "\n";
+            streams[i]->close();
+            delete streams[i];
+            streams[i] = NULL;
+        }
+    };
+    // moves to the source table of target, source tables without hits still get their (empty) result DBs
+    auto seekSource = [&](uint64_t target) {
+        while (sourceOpen == false || (source + 1 < sourceOffsets.size() && target >= sourceOffsets[source + 1])) {
+            if (sourceOpen) {
+                closeSource();
+                ++source;
+            }
+            openSource(source);
+            sourceOpen = true;
+        }
+    };
+    auto writeSettings = [&](ResultDBStream **setStreams, Entry *begin, Entry *end) {
+        if (sweep.empty()) {
+            Entry *truncatedEnd = removeNotHitSequences(begin, end, par.requiredKmerMatches);
+            setStreams[0]->countEntries(end - begin, truncatedEnd - begin);
+            setStreams[0]->writeTarget(begin, truncatedEnd, buffer);
+            return;
+        }
+        // selecting the entries of a setting keeps the result table order
+        for (size_t s = 0; s < sweep.size(); ++s) {
+            settingHits.clear();
+            for (Entry *entry = begin; entry < end; ++entry) {
+                if (sweep[s].accepts(*entry)) {
+                    settingHits.emplace_back(*entry);
+                }
+            }
+            Entry *settingBegin = settingHits.data();
+            Entry *settingEnd = settingBegin + settingHits.size();
+            Entry *truncatedEnd = removeNotHitSequences(settingBegin, settingEnd, par.requiredKmerMatches);
+            setStreams[s]->countEntries(settingEnd - settingBegin, truncatedEnd - settingBegin);
+            setStreams[s]->writeTarget(settingBegin, truncatedEnd, buffer);
+        }
+    };
+
+    // min-heap of (next ID, hot k-mer hit) over the ID sets of all hot k-mer hits
+    std::vector<HotKmerPostings::IdIterator> hotIds;
+    hotIds.reserve(hotHits.size());
+    std::vector<std::pair<uint64_t, size_t>> heap;
+    std::greater<std::pair<uint64_t, size_t>> heapOrder;
+    for (size_t h = 0; h < hotHits.size(); ++h) {
+        hotIds.emplace_back(hotKmers, hotHits[h].hotKmer);
+        heap.emplace_back(hotIds[h].getId(), h);
+    }
+    std::make_heap(heap.begin(), heap.end(), heapOrder);
 
-            size_t equalKmers = 0;
-            unsigned long long currentKmer = 0;
-            bool first = true;
-            uint64_t currDiffIndex = 0;
+    size_t pos = 0;
+    while (pos < hits.size() || heap.empty() == false) {
+        uint64_t target = pos < hits.size() ? (uint64_t) hits[pos].targetSequenceID : UINT64_MAX;
+        if (heap.empty() == false) {
+            target = std::min(target, heap.front().first);
+        }
+        size_t end = pos;
+        while (end < hits.size() && hits[end].targetSequenceID == target) {
+            ++end;
+        }
+        Entry *targetBegin = hits.data() + pos;
+        Entry *targetEnd = hits.data() + end;
+        if (heap.empty() == false && heap.front().first == target) {
+            targetHits.assign(targetBegin, targetEnd);
+            while (heap.empty() == false && heap.front().first == target) {
+                const size_t h = heap.front().second;
+                const unsigned long long kmer = hotKmers.getKmer(hotHits[h].hotKmer);
+                for (size_t i = hotHits[h].groupStart; i < hotHits[h].groupEnd; ++i) {
+                    targetHits.emplace_back(query.getEntry(i, kmer, target));
+                }
+                std::pop_heap(heap.begin(), heap.end(), heapOrder);
+                heap.pop_back();
+                hotIds[h].next();
+                if (hotIds[h].atEnd() == false) {
+                    heap.emplace_back(hotIds[h].getId(), h);
+                    std::push_heap(heap.begin(), heap.end(), heapOrder);
+                }
+            }
+            targetBegin = targetHits.data();
+            targetEnd = targetBegin + targetHits.size();
+            SORT_SERIAL(targetBegin, targetEnd, resultTableSort<Entry>);
+        }
+        pos = end;
 
-            bool breakOut = false;
+        seekSource(target);
+        for (Entry *entry = targetBegin; entry < targetEnd; ++entry) {
+            entry->targetSequenceID -= sourceOffsets[source];
+        }
 
-            unsigned long long totalBlocksRead = numOfTargetBlocks;
-            size_t targetReadGroup = 0;
+        // the entries of a target are sorted by query, so each query set is a single run
+        Entry *setBegin = targetBegin;
+        while (setBegin < targetEnd) {
+            const size_t set = std::upper_bound(querySetOffsets.begin(), querySetOffsets.end(), (size_t) setBegin->querySequenceId)
+                               - querySetOffsets.begin() - 1;
+            Entry *setEnd = setBegin;
+            while (setEnd < targetEnd && setEnd->querySequenceId < querySetOffsets[set + 1]) {
+                setEnd->querySequenceId -= (unsigned int) querySetOffsets[set];
+                ++setEnd;
+            }
+            writeSettings(streams.data() + set * settings, setBegin, setEnd);
+            setBegin = setEnd;
+        }
+    }
+    seekSource(UINT64_MAX);
+    closeSource();
+}
 
-            while (numOfTargetBlocks == totalNumOfTargetBlocks || totalBlocksRead < totalNumOfTargetBlocks) {
-                for (size_t j = 0; j < numOfTargetBlocks; j++) {
-                    unsigned short *startPosTargetTable, *endTargetPos, *currentTargetPos;
-                    startPosTargetTable = (unsigned short *) targetTableBlocks[j];
-                    endTargetPos = startPosTargetTable + (targetTableBlockSize[j] / sizeof(unsigned short));
-                    currentTargetPos = startPosTargetTable;
-                    // cover the rare case that the first (real) target entry is larger than USHRT_MAX
-                    while (currentTargetPos < endTargetPos && !IS_LAST_15_BITS(*currentTargetPos)) {
-                        currDiffIndex = DECODE_15_BITS(currDiffIndex, *currentTargetPos);
-                        currDiffIndex <<= 15U;
-                        ++currentTargetPos;
-                    }
-                    currDiffIndex = DECODE_15_BITS(currDiffIndex, *currentTargetPos);
-                    currentKmer += currDiffIndex;
-                    currDiffIndex = 0;
-
-                    while (LIKELY(currentTargetPos < endTargetPos) && currentQueryPos < endQueryPos) {
-                        if (currentKmer == currentQueryPos->Query.kmer) {
-                            if (first) {
-                                startPosQueryTable = currentQueryPos;
-                                first = false;
-                            }
-                            ++equalKmers;
-                            currentQueryPos->targetSequenceID = *currentIDPos;
-                            ++currentQueryPos;
-                            while (LIKELY(currentQueryPos < endQueryPos) &&
-                                   currentQueryPos->Query.kmer == currentKmer) {
-                                currentQueryPos->targetSequenceID = *currentIDPos;
-                                ++currentQueryPos;
-                            }
-                            endPosQueryTable = currentQueryPos;
-                            ++currentTargetPos;
-                            ++currentIDPos;
-                            if (UNLIKELY(currentIDPos >= endIDPos)) {
-                                ++IDTableIndex;
-                                if (UNLIKELY(IDTableIndex >= numOfIDBlocks)) {
-                                    // parallel read
-                                    parallelReadIntoVec(
-                                        fdIDTable, IDTableBlocks, IDTableBlockSize, MEM_SIZE_32MB, false, ++IDReadGroup
-                                    );
-                                    IDTableIndex = 0;
-                                }
-                                startPosIDTable = (unsigned int *) IDTableBlocks[IDTableIndex];
-                                currentIDPos = startPosIDTable;
-                                endIDPos = startPosIDTable + (MEM_SIZE_32MB / sizeof(unsigned int));
-                            }
-                            while (UNLIKELY(currentTargetPos < endTargetPos && !IS_LAST_15_BITS(*currentTargetPos))) {
-                                currDiffIndex = DECODE_15_BITS(currDiffIndex, *currentTargetPos);
-                                currDiffIndex <<= 15U;
-                                ++currentTargetPos;
-                            }
-                            if (UNLIKELY(currentTargetPos >= endTargetPos)) {
-                                break;
-                            }
-                            currDiffIndex = DECODE_15_BITS(currDiffIndex, *currentTargetPos);
-                            currentKmer += currDiffIndex;
-                            currDiffIndex = 0;
-                        }
+/**
+ * @brief Joins the query DBs with all target tables, Entry is the query table entry type picked by comparekmertables
+ */
+template <typename Entry>
+void compareKmerTables(
+    LocalParameters &par, const std::vector<std::string> &queryDBs, const std::vector<SensitivitySetting> &sweep,
+    const std::vector<std::string> &targetTables, const std::vector<std::string> &resultFiles
+) {
+    std::vector<Entry> qTable;
+    // query keys of set q are shifted by querySetOffsets[q], so that all sets can share one sorted query table
+    std::vector<size_t> querySetOffsets(1, 0);
+    for (size_t q = 0; q < queryDBs.size(); ++q) {
+        const size_t keyCount = createQueryTable(par, queryDBs[q], qTable, sweep, (unsigned int) querySetOffsets[q]);
+        querySetOffsets.emplace_back(querySetOffsets[q] + keyCount);
+        if (querySetOffsets.back() >= UINT_MAX) {
+            Debug(Debug::ERROR) << "Too many query keys in the query DBs for a single pass\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+    Timer sortTimer;
+    SORT_PARALLEL(qTable.begin(), qTable.end(), queryTableSort<Entry>);
+    Debug(Debug::INFO) << "Sorting time: " << sortTimer.lap() << "\n";
+
+    const size_t queryTableEntries = qTable.size();
+    CompressedQueryTable *compressedQTable = NULL;
+    unsigned long queryTableSize = qTable.size() * sizeof(Entry);
+    if (par.compressQueryTable) {
+        Timer timer;
+        compressedQTable = new CompressedQueryTable(qTable);
+        std::vector<Entry>().swap(qTable);
+        Debug(Debug::INFO) << "Compressed query table: " << queryTableSize / 1024 / 1024 << " MB -> "
+                           << compressedQTable->getMemorySize() / 1024 / 1024 << " MB ("
+                           << (double) compressedQTable->getMemorySize() / (double) std::max(queryTableEntries, (size_t) 1) << " bytes per entry)"
+                           << "\ntime: " << timer.lap() << "\n";
+        queryTableSize = compressedQTable->getMemorySize();
+    }
+    queryTableSize = std::max(queryTableSize, 1UL);
 
-                        while (LIKELY(currentQueryPos < endQueryPos) &&
-                               currentQueryPos->Query.kmer < currentKmer) {
-                            ++currentQueryPos;
-                        }
+    const size_t numQTableAvailInMem = Util::getTotalSystemMemory() / 3 / queryTableSize;
+    // const size_t chunkSize = numQTableAvailInMem >= targetTables.size() ? 1 : targetTables.size() / numQTableAvailInMem;
 
-                        while (currentQueryPos < endQueryPos &&
-                               currentTargetPos < endTargetPos &&
-                               currentKmer < currentQueryPos->Query.kmer) {
-                            ++currentTargetPos;
-                            ++currentIDPos;
-                            if (UNLIKELY(currentIDPos >= endIDPos)) {
-                                ++IDTableIndex;
-                                if (UNLIKELY(IDTableIndex >= numOfIDBlocks)) {
-                                    // parallel read
-                                    parallelReadIntoVec(
-                                        fdIDTable, IDTableBlocks, IDTableBlockSize, MEM_SIZE_32MB, false, ++IDReadGroup
-                                    );
-                                    IDTableIndex = 0;
-                                }
-                                startPosIDTable = (unsigned int *) IDTableBlocks[IDTableIndex];
-                                currentIDPos = startPosIDTable;
-                                endIDPos = startPosIDTable + (MEM_SIZE_32MB / sizeof(unsigned int));
-                            }
-                            while (UNLIKELY(currentTargetPos < endTargetPos && !IS_LAST_15_BITS(*currentTargetPos))) {
-                                currDiffIndex = DECODE_15_BITS(currDiffIndex, *currentTargetPos);
-                                currDiffIndex <<= 15U;
-                                ++currentTargetPos;
-                            }
-                            if (UNLIKELY(currentTargetPos >= endTargetPos)) {
-                                breakOut = true;
-                                break;
-                            }
-                            currDiffIndex = DECODE_15_BITS(currDiffIndex, *currentTargetPos);
-                            currentKmer += currDiffIndex;
-                            currDiffIndex = 0;
-                        }
-                        if (UNLIKELY(breakOut)) {
-                            breakOut = false;
-                            break;
-                        }
-                    }
-                }
+    const unsigned long MAXIMUM_NUM_OF_BLOCKS =
+            (Util::getTotalSystemMemory() - numQTableAvailInMem * queryTableSize) / (MEM_SIZE_16MB + MEM_SIZE_32MB);
+    const unsigned long maximumNumOfBlocksPerDB = MAXIMUM_NUM_OF_BLOCKS / targetTables.size();
 
-                if (numOfTargetBlocks == totalNumOfTargetBlocks) {
-                    break;
+    // each thread joins groups of tablesPerPass target tables in a single pass over the query table
+    const size_t tablesPerPass = std::max(par.targetTablesPerPass, 1);
+    const size_t targetGroups = (targetTables.size() + tablesPerPass - 1) / tablesPerPass;
+    size_t localThreads = par.threads;
+#ifdef OPENMP
+    localThreads = std::max(std::min(localThreads, targetGroups), (size_t)1);
+#endif
+
+#pragma omp parallel num_threads(localThreads) default(none) shared(par, resultFiles, qTable, compressedQTable, targetTables, std::cerr, std::cout, maximumNumOfBlocksPerDB, sweep, querySetOffsets) firstprivate(tablesPerPass, targetGroups)
+    {
+        Timer timer;
+        // the query table is only read during the join, so all threads share the same table
+        std::vector<std::vector<Entry>> groupHits(tablesPerPass);
+        std::vector<std::vector<HotKmerHit>> groupHotHits(tablesPerPass);
+
+#pragma omp for schedule(dynamic, 1)
+        for (size_t group = 0; group < targetGroups; ++group) {
+            timer.reset();
+            const size_t groupBegin = group * tablesPerPass;
+            const size_t groupSize = std::min(tablesPerPass, targetTables.size() - groupBegin);
+
+            std::vector<size_t> equalKmers(groupSize);
+            size_t targetDataSize = 0;
+            if (groupSize == 1) {
+                groupHits[0].clear();
+                TargetTableReader targetTable(targetTables[groupBegin], maximumNumOfBlocksPerDB);
+                targetDataSize = targetTable.getDataSize();
+                if (compressedQTable != NULL) {
+                    CompressedQueryTableCursor<Entry> cursor(*compressedQTable);
+                    equalKmers[0] = joinTargetTable(cursor, targetTable, groupHits[0]);
+                } else {
+                    QueryTableCursor<Entry> cursor(qTable);
+                    equalKmers[0] = joinTargetTable(cursor, targetTable, groupHits[0]);
+                }
+            } else {
+                std::vector<TargetTableReader *> groupTables(groupSize);
+                for (size_t t = 0; t < groupSize; ++t) {
+                    groupHits[t].clear();
+                    groupTables[t] = new TargetTableReader(targetTables[groupBegin + t], maximumNumOfBlocksPerDB);
+                    targetDataSize += groupTables[t]->getDataSize();
+                }
+                if (compressedQTable != NULL) {
+                    CompressedQueryTableCursor<Entry> cursor(*compressedQTable);
+                    equalKmers = joinTargetTables(cursor, groupTables, groupHits);
+                } else {
+                    QueryTableCursor<Entry> cursor(qTable);
+                    equalKmers = joinTargetTables(cursor, groupTables, groupHits);
+                }
+                for (size_t t = 0; t < groupSize; ++t) {
+                    delete groupTables[t];
+                }
+            }
+            std::vector<HotKmerPostings> hotKmers(groupSize);
+            for (size_t t = 0; t < groupSize; ++t) {
+                groupHotHits[t].clear();
+                if (hotKmers[t].read(targetTables[groupBegin + t])) {
+                    targetDataSize += hotKmers[t].getDataSize();
+                    if (compressedQTable != NULL) {
+                        CompressedQueryTableCursor<Entry> cursor(*compressedQTable);
+                        equalKmers[t] += joinHotKmers(cursor, hotKmers[t], groupHotHits[t]);
+                    } else {
+                        QueryTableCursor<Entry> cursor(qTable);
+                        equalKmers[t] += joinHotKmers(cursor, hotKmers[t], groupHotHits[t]);
+                    }
                 }
-                parallelReadIntoVec(
-                    fdTargetTable, targetTableBlocks, targetTableBlockSize, MEM_SIZE_16MB, false, ++targetReadGroup
-                );
-                totalBlocksRead += numOfTargetBlocks;
             }
 
             double timediff = timer.getTimediff();
             Debug(Debug::INFO) << timediff << " s; Rate "
-                               << ((double) (targetTableSize + idTableSize) / 1e+9) / timediff << " GB/s \n";
-            Debug(Debug::INFO) << "Number of equal k-mers: " << equalKmers << "\n";
-
-            for (size_t j = 0; j < numOfTargetBlocks; j++) {
-                free(targetTableBlocks[j]);
-            }
-            for (size_t j = 0; j < numOfIDBlocks; j++) {
-                free(IDTableBlocks[j]);
+                               << ((double) targetDataSize / 1e+9) / timediff << " GB/s \n";
+
+            for (size_t t = 0; t < groupSize; ++t) {
+                const size_t i = groupBegin + t;
+                std::vector<Entry> &hits = groupHits[t];
+                Debug(Debug::INFO) << "Number of equal k-mers: " << equalKmers[t] << "\n";
+
+                timer.reset();
+                SORT_SERIAL(hits.begin(), hits.end(), resultTableSort<Entry>);
+                Debug(Debug::INFO) << "Result table sort time: " << timer.lap() << "\n";
+                timer.reset();
+
+                // a table written by mergekmertables is split back into one result DB per source table
+                const std::vector<uint64_t> targetOffsets = TargetTableReader::readInfo(targetTables[i]);
+                if (compressedQTable != NULL) {
+                    CompressedQueryTableCursor<Entry> cursor(*compressedQTable);
+                    writeTargetTableResults(par, sweep, querySetOffsets, resultFiles[i], targetOffsets, hits, groupHotHits[t], hotKmers[t], cursor);
+                } else {
+                    QueryTableCursor<Entry> cursor(qTable);
+                    writeTargetTableResults(par, sweep, querySetOffsets, resultFiles[i], targetOffsets, hits, groupHotHits[t], hotKmers[t], cursor);
+                }
+                Debug(Debug::INFO) << "Result write time: " << timer.lap() << "\n";
             }
+        }
+    }
+    delete compressedQTable;
+}
 
-            if (close(fdIDTable) < 0) {
-                Debug(Debug::ERROR) << "Cannot close ID table\n";
-                EXIT(EXIT_FAILURE);
-            }
+int comparekmertables(int argc, const char **argv, const Command &command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.spacedKmer = false;
 
-            if (close(fdTargetTable) < 0) {
-                Debug(Debug::ERROR) << "Cannot close target table\n";
-                EXIT(EXIT_FAILURE);
-            }
+    par.parseParameters(argc, argv, command, true, 0, LocalParameters::PARSE_VARIADIC);
 
-            timer.reset();
-            QueryTableEntry *resultTableEndPos = copyHitSequences(startPosQueryTable, endPosQueryTable, resultTable);
-            Debug(Debug::INFO) << "Not hit kmer elimination time: " << timer.lap() << "\n";
-            timer.reset();
-            
-            timer.reset();
-            SORT_SERIAL(resultTable, resultTableEndPos, resultTableSort);
-            Debug(Debug::INFO) << "Result table sort time: " << timer.lap() << "\n";
-            timer.reset();
+    // the query DB given as argument is query set 0, the DBs of --query-db-list follow as set 1, 2, ...
+    std::vector<std::string> queryDBs(1, par.db1);
+    if (par.queryDbList.empty() == false) {
+        std::vector<std::string> listedDBs = SRAUtil::getFileNamesFromFile(par.queryDbList);
+        queryDBs.insert(queryDBs.end(), listedDBs.begin(), listedDBs.end());
+    }
+    const int queryDbType = FileUtil::parseDbType(par.db1.c_str());
+    for (size_t q = 1; q < queryDBs.size(); ++q) {
+        if (Parameters::isEqualDbtype(FileUtil::parseDbType(queryDBs[q].c_str()), queryDbType) == false) {
+            Debug(Debug::ERROR) << "Query DB " << queryDBs[q] << " has a different type than " << par.db1 << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
 
-            QueryTableEntry *truncatedResultEndPos = removeNotHitSequences(resultTable, resultTableEndPos, par.requiredKmerMatches);
-            Debug(Debug::INFO) << "Duplicate elimination time: " << timer.lap() << "\n";
-            timer.reset();
-            Debug(Debug::INFO) << "Reduced k-mers " << (endPosQueryTable - startPosQueryTable) << " -> " << (resultTableEndPos - resultTable) << " -> " << (truncatedResultEndPos - resultTable) << "\n";
-
-            std::string resultDB = resultFiles[i];
-            DBWriter writer(
-                resultDB.c_str(), (resultDB + ".index").c_str(), 1, par.compressed, Parameters::DBTYPE_PREFILTER_RES
-            );
-            writer.open();
-
-            for (QueryTableEntry *currentPos = resultTable; currentPos < truncatedResultEndPos - 1; ++currentPos) {
-//        bool didAppend = false;
-                while (currentPos < truncatedResultEndPos - 1 && currentPos->targetSequenceID == (currentPos + 1)->targetSequenceID) {
-                    size_t len = QueryTableEntry::queryEntryToBuffer(buffer, *currentPos);
-//            if (didAppend == false) {
-                    result.append(buffer, len);
-//                didAppend = true;
-//            }
-                    ++currentPos;
-                }
-                writer.writeData(result.c_str(), result.length(), currentPos->targetSequenceID, 0);
-                result.clear();
-            }
-            writer.close();
-            result.clear();
-            Debug(Debug::INFO) << "Result write time: " << timer.lap() << "\n";
+    std::vector<SensitivitySetting> sweep = parseSensitivitySweep(par.sensitivitySweep);
+    if (sweep.empty() == false) {
+        SensitivitySetting primary;
+        primary.kmerScore = Parameters::isEqualDbtype(queryDbType, Parameters::DBTYPE_HMM_PROFILE)
+                            ? par.kmerScore.values.profile() : par.kmerScore.values.sequence();
+        primary.maxKmerPerPos = par.maxKmerPerPos;
+        sweep.insert(sweep.begin(), primary);
+    }
 
-        }
-        delete[] localQTable;
-        delete[] resultTable;
+    // FIXME: accept single file input also
+    std::vector<std::string> targetTables = SRAUtil::getFileNamesFromFile(par.db2);
+    std::vector<std::string> resultFiles = SRAUtil::getFileNamesFromFile(par.db3);
+    if (targetTables.empty()) {
+        Debug(Debug::ERROR) << "Expected at least one targetTable entry in the target table file\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (targetTables.size() != resultFiles.size()) {
+        Debug(Debug::ERROR) << "Number of targetTable and result table is not equal\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (par.kmerSampling == KmerSampling::SYNCMER && par.kmerSamplingWindow > par.kmerSize) {
+        Debug(Debug::ERROR) << "The k-mer sampling window cannot be larger than the k-mer size for syncmers\n";
+        EXIT(EXIT_FAILURE);
+    }
+    const std::string kmerParameters = SRAUtil::getKmerParameters(par);
+    for (size_t i = 0; i < targetTables.size(); ++i) {
+        SRAUtil::checkKmerParameters(targetTables[i], kmerParameters);
+    }
+
+    std::vector<size_t> indices = roundRobinOrder(targetTables);
+    reorderVectorInPlace(targetTables, indices);
+    reorderVectorInPlace(resultFiles, indices);
+
+    // entries only take 40-bit target IDs if a merged table needs them, and keep score and rank of the similar k-mers
+    // only if a sweep has to select them later
+    bool wideIds = false;
+    for (size_t i = 0; i < targetTables.size(); ++i) {
+        wideIds |= TargetTableReader::readIdBytes(targetTables[i]) == 5;
+    }
+    if (wideIds == false && sweep.empty()) {
+        compareKmerTables<QueryTableEntry>(par, queryDBs, sweep, targetTables, resultFiles);
+    } else if (wideIds == false) {
+        compareKmerTables<ScoredQueryTableEntry<QueryTableEntry>>(par, queryDBs, sweep, targetTables, resultFiles);
+    } else if (sweep.empty()) {
+        compareKmerTables<WideQueryTableEntry>(par, queryDBs, sweep, targetTables, resultFiles);
+    } else {
+        compareKmerTables<ScoredQueryTableEntry<WideQueryTableEntry>>(par, queryDBs, sweep, targetTables, resultFiles);
     }
 
     return EXIT_SUCCESS;
@@ -5,57 +5,45 @@
 #include "NucleotideMatrix.h"
 #include "QueryTableEntry.h"
 #include "TargetTableEntry.h"
+#include "TargetTableWriter.h"
 #include "ExtendedSubstitutionMatrix.h"
 #include "BitManipulateMacros.h"
 #include "FastSort.h"
 #include "Indexer.h"
+#include "KmerIndex.h"
+#include "KmerSampling.h"
+#include "SRAUtil.h"
+#include "tantan.h"
 
 #include <sys/mman.h>
 #include <algorithm>
+#include <map>
 
 #ifdef OPENMP
 #include <omp.h>
 #endif
 
-#define KMER_BUFSIZ 500000000
-#define ID_BUFSIZ 250000000
-
-void writeTargetTables(TargetTableEntry *targetTable, size_t kmerCount, const std::string &blockID);
+void writeTargetTables(TargetTableEntry *targetTable, size_t kmerCount, const std::string &blockID, unsigned int maxMultiplicity);
 
 int queryTableSort(const QueryTableEntry &first, const QueryTableEntry &second);
 
 int targetTableSort(const TargetTableEntry &first, const TargetTableEntry &second);
 
-void writeKmerDiff(size_t lastKmer, TargetTableEntry *entryToWrite, FILE *handleKmerTable, FILE *handleIDTable,
-                   uint16_t *kmerBuf, unsigned int *IDBuf);
-
-static inline void writeKmer(uint16_t *buffer, FILE *handleKmerTable, uint16_t *toWrite, size_t size);
-
-static inline void writeID(unsigned int *buffer, FILE *handleIDTable, unsigned int toWrite);
-
-static inline void flushKmerBuf(uint16_t *buffer, FILE *handleKmerTable);
-
-static inline void flushIDBuf(unsigned int *buffer, FILE *handleIDTable);
-
-static unsigned int kmerBufIdx = 0;
-static unsigned int IDBufIdx = 0;
-
 int createkmertable(int argc, const char **argv, const Command &command) {
     LocalParameters &par = LocalParameters::getLocalInstance();
     par.spacedKmer = false;
     par.parseParameters(argc, argv, command, true, 0, 0);
     Timer timer;
+    if (par.kmerSampling == KmerSampling::SYNCMER && par.kmerSamplingWindow > par.kmerSize) {
+        Debug(Debug::ERROR) << "The k-mer sampling window cannot be larger than the k-mer size for syncmers\n";
+        EXIT(EXIT_FAILURE);
+    }
 
     SRADBReader reader(par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA);
     reader.open(DBReader<unsigned int>::LINEAR_ACCCESS);
 
-    BaseMatrix *subMat;
     int seqType = reader.getDbtype();
-    if (Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_NUCLEOTIDES)) {
-        subMat = new NucleotideMatrix(par.seedScoringMatrixFile.values.nucleotide().c_str(), 1.0, 0.0);
-    } else {
-        subMat = new SubstitutionMatrix(par.seedScoringMatrixFile.values.aminoacid().c_str(), 8.0, -0.2f);
-    }
+    BaseMatrix *subMat = SRAUtil::getKmerMatrix(par, Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_NUCLEOTIDES), 8.0, -0.2f);
     Debug(Debug::INFO) << "input prepared, time spent: " << timer.lap() << "\n";
     size_t kmerCount = 0;
     const unsigned int kmerSize = par.kmerSize;
@@ -84,9 +72,16 @@ int createkmertable(int argc, const char **argv, const Command &command) {
     const size_t pageSize = Util::getPageSize();
     const size_t threadBufferSize = 16 * pageSize;
 
+    // masked residues are set to X, so k-mers overlapping a masked region are not indexed
+    ProbabilityMatrix *probMatrix = NULL;
+    if (par.maskTarget == 1) {
+        probMatrix = new ProbabilityMatrix(*subMat);
+    }
+    size_t maskedResidues = 0;
+
     size_t tableIndex = 0;
     Debug::Progress progress(reader.getSize());
-#pragma omp parallel default(none) shared(par, subMat, seqType, reader, tableIndex, targetTable, pageSize, threadBufferSize)
+#pragma omp parallel default(none) shared(par, subMat, seqType, reader, tableIndex, targetTable, pageSize, threadBufferSize, probMatrix) reduction(+:maskedResidues)
     {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
@@ -96,6 +91,9 @@ int createkmertable(int argc, const char **argv, const Command &command) {
         Sequence s(par.maxSeqLen, seqType, subMat, par.kmerSize, par.spacedKmer, false, false, par.spacedKmerPattern);
         TargetTableEntry *localBuffer = (TargetTableEntry *) mem_align(pageSize, threadBufferSize * sizeof(TargetTableEntry));
         size_t localTableIndex = 0;
+        std::vector<size_t> sequenceKmers;
+        std::vector<uint64_t> kmerHashes;
+        std::vector<unsigned char> selected;
 #pragma omp for schedule(dynamic, 1)
         for (size_t i = 0; i < reader.getSize(); ++i) {
 //            progress.updateProgress();
@@ -103,12 +101,52 @@ int createkmertable(int argc, const char **argv, const Command &command) {
             char *data = reader.getData(i, thread_idx);
             unsigned int seqLen = reader.getSeqLen(i);
             s.mapSequence(i, key, data, seqLen);
-            while (s.hasNextKmer()) {
-                const unsigned char *kmer = s.nextKmer();
-                if (s.kmerContainsX()) {
-                    continue;
+            if (probMatrix != NULL) {
+                maskedResidues += tantan::maskSequences(
+                    (char*)s.numSequence,
+                    (char*)(s.numSequence + s.L),
+                    50 /*options.maxCycleLength*/,
+                    probMatrix->probMatrixPointers,
+                    0.005 /*options.repeatProb*/,
+                    0.05 /*options.repeatEndProb*/,
+                    0.5 /*options.repeatOffsetProbDecay*/,
+                    0, 0,
+                    par.maskProb /*options.minMaskProb*/,
+                    probMatrix->hardMaskTable
+                );
+            }
+            if (par.kmerSampling == KmerSampling::MINIMIZER) {
+                // minimizers need all k-mers of the sequence, k-mers containing X only break windows
+                sequenceKmers.clear();
+                kmerHashes.clear();
+                while (s.hasNextKmer()) {
+                    const unsigned char *kmer = s.nextKmer();
+                    const size_t index = kmerIndex(kmer, idx.powers, par.kmerSize);
+                    sequenceKmers.emplace_back(index);
+                    kmerHashes.emplace_back(s.kmerContainsX() ? UINT64_MAX : KmerSampling::hash(index));
                 }
-                localBuffer[localTableIndex].kmerAsLong = idx.int2index(kmer, 0, par.kmerSize);
+                KmerSampling::selectMinimizers(kmerHashes, par.kmerSamplingWindow, selected);
+            }
+            size_t kmerPos = 0;
+            while (par.kmerSampling == KmerSampling::MINIMIZER ? kmerPos < sequenceKmers.size() : s.hasNextKmer()) {
+                size_t index;
+                if (par.kmerSampling == KmerSampling::MINIMIZER) {
+                    index = sequenceKmers[kmerPos];
+                    if (selected[kmerPos++] == 0) {
+                        continue;
+                    }
+                } else {
+                    const unsigned char *kmer = s.nextKmer();
+                    if (s.kmerContainsX()) {
+                        continue;
+                    }
+                    index = kmerIndex(kmer, idx.powers, par.kmerSize);
+                    if (par.kmerSampling == KmerSampling::SYNCMER
+                        && KmerSampling::isSyncmer(index, idx.powers, par.kmerSize, par.kmerSamplingWindow) == false) {
+                        continue;
+                    }
+                }
+                localBuffer[localTableIndex].kmerAsLong = index;
                 localBuffer[localTableIndex].sequenceID = s.getId(); // for debug purposes: s.getDbKey();
                 localBuffer[localTableIndex].sequenceLength = s.L;
                 ++localTableIndex;
@@ -126,10 +164,15 @@ int createkmertable(int argc, const char **argv, const Command &command) {
         free(localBuffer);
     }
 
+    delete probMatrix;
+    if (par.maskTarget == 1) {
+        Debug(Debug::INFO) << "Masked residues: " << maskedResidues << "\n";
+    }
     Debug(Debug::INFO) << "k-mers: " << tableIndex << " time: " << timer.lap() << "\n";
     SORT_PARALLEL(targetTable, targetTable + tableIndex, targetTableSort);
     Debug(Debug::INFO) << "Sorting time: " << timer.lap() << "\n";
-    writeTargetTables(targetTable, tableIndex, par.db2);
+    writeTargetTables(targetTable, tableIndex, par.db2, par.maxKmerMultiplicity);
+    SRAUtil::writeKmerParameters(par.db2, SRAUtil::getKmerParameters(par));
     Debug(Debug::INFO) << "Writing time: " << timer.lap() << "\n";
     free(targetTable);
 
@@ -161,85 +204,55 @@ int targetTableSort(const TargetTableEntry &first, const TargetTableEntry &secon
     return false;
 }
 
-void writeTargetTables(TargetTableEntry *targetTable, size_t kmerCount, const std::string &blockID) {
+// histogram of the number of occurrences per k-mer, written as tab separated multiplicity and k-mer count
+void writeMultiplicityHistogram(const std::map<size_t, size_t> &histogram, const std::string &fileName) {
+    FILE *handle = fopen(fileName.c_str(), "w");
+    if (handle == NULL) {
+        Debug(Debug::ERROR) << "Cannot open " << fileName << " for writing\n";
+        EXIT(EXIT_FAILURE);
+    }
+    fprintf(handle, "#multiplicity\tkmers\n");
+    for (std::map<size_t, size_t>::const_iterator it = histogram.begin(); it != histogram.end(); ++it) {
+        fprintf(handle, "%zu\t%zu\n", it->first, it->second);
+    }
+    fclose(handle);
+}
+
+void writeTargetTables(TargetTableEntry *targetTable, size_t kmerCount, const std::string &blockID, unsigned int maxMultiplicity) {
     const std::string &kmerTableFileName = blockID;
     std::string idTableFileName = blockID + "_ids";
     Debug(Debug::INFO) << "Writing k-mer target table to file: " << kmerTableFileName << "\n";
     Debug(Debug::INFO) << "Writing target ID table to file:  " << idTableFileName << "\n";
-    FILE *handleKmerTable = fopen(kmerTableFileName.c_str(), "wb");
-    FILE *handleIDTable = fopen(idTableFileName.c_str(), "wb");
+    TargetTableWriter writer(kmerTableFileName);
     TargetTableEntry *entryToWrite = targetTable;
     TargetTableEntry *posInTable = targetTable;
-    size_t uniqueKmerCount = 0;
-    size_t lastKmer = 0;
+    std::map<size_t, size_t> histogram;
+    size_t skippedKmers = 0;
+    size_t skippedOccurrences = 0;
 //    Debug::Progress progress(kmerCount);
 
-    uint16_t *kmerLocalBuf = (uint16_t *) malloc(sizeof(uint16_t) * KMER_BUFSIZ);
-    unsigned int *IDLocalBuf = (unsigned int *) malloc(sizeof(unsigned int) * ID_BUFSIZ);
-    for (size_t i = 0; i < kmerCount; ++i, ++posInTable) {
+    // only the first entry (longest sequence) of each k-mer is kept, k-mers above maxMultiplicity are skipped
+    for (size_t i = 0; i <= kmerCount; ++i, ++posInTable) {
 //        progress.updateProgress();
-        if (posInTable->kmerAsLong != entryToWrite->kmerAsLong) {
-            writeKmerDiff(lastKmer, entryToWrite, handleKmerTable, handleIDTable, kmerLocalBuf, IDLocalBuf);
-            lastKmer = entryToWrite->kmerAsLong;
+        if (i == kmerCount || posInTable->kmerAsLong != entryToWrite->kmerAsLong) {
+            const size_t multiplicity = std::max(posInTable - entryToWrite, (ptrdiff_t) 1);
+            histogram[multiplicity]++;
+            if (maxMultiplicity == 0 || multiplicity <= maxMultiplicity) {
+                writer.writeEntry(entryToWrite->kmerAsLong, entryToWrite->sequenceID);
+            } else {
+                ++skippedKmers;
+                skippedOccurrences += multiplicity;
+            }
             entryToWrite = posInTable;
-            ++uniqueKmerCount;
         }
     }
-    // write last one
-    writeKmerDiff(lastKmer, entryToWrite, handleKmerTable, handleIDTable, kmerLocalBuf, IDLocalBuf);
-    ++uniqueKmerCount;
-
-    flushKmerBuf(kmerLocalBuf, handleKmerTable);
-    flushIDBuf(IDLocalBuf, handleIDTable);
-    free(kmerLocalBuf);
-    free(IDLocalBuf);
-    fclose(handleKmerTable);
-    fclose(handleIDTable);
-    Debug(Debug::INFO) << "Wrote " << uniqueKmerCount << " unique k-mers\n";
+    writer.close();
+    writeMultiplicityHistogram(histogram, blockID + "_multiplicity");
+    Debug(Debug::INFO) << "Wrote " << writer.getEntryCount() << " unique k-mers\n";
+    if (maxMultiplicity > 0) {
+        Debug(Debug::INFO) << "Skipped " << skippedKmers << " k-mers with " << skippedOccurrences
+                           << " occurrences above multiplicity " << maxMultiplicity << "\n";
+    }
 //    Debug(Debug::INFO) << "For "<< entryDiffLargerUShortMax  << " entries the difference between the previous were larger than max short.\n";
 //    Debug(Debug::INFO) << "Created " << diffLargerThenUShortMax << " extra unsigned short max entries to store the diff.\n";
 }
-
-static inline void flushKmerBuf(uint16_t *buffer, FILE *handleKmerTable) {
-    fwrite(buffer, sizeof(uint16_t), kmerBufIdx, handleKmerTable);
-    kmerBufIdx = 0;
-}
-
-static inline void flushIDBuf(unsigned int *buffer, FILE *handleIDTable) {
-    fwrite(buffer, sizeof(unsigned int), IDBufIdx, handleIDTable);
-    IDBufIdx = 0;
-}
-
-static inline void writeKmer(uint16_t *buffer, FILE *handleKmerTable, uint16_t *toWrite, size_t size) {
-    if (kmerBufIdx + size >= KMER_BUFSIZ) {
-        flushKmerBuf(buffer, handleKmerTable);
-    }
-    memcpy(buffer + kmerBufIdx, toWrite, sizeof(uint16_t) * size);
-    kmerBufIdx += size;
-}
-
-static inline void writeID(unsigned int *buffer, FILE *handleIDTable, unsigned int toWrite) {
-    if (IDBufIdx == ID_BUFSIZ) {
-        flushIDBuf(buffer, handleIDTable);
-    }
-    buffer[IDBufIdx] = toWrite;
-    IDBufIdx++;
-}
-
-void writeKmerDiff(size_t lastKmer, TargetTableEntry *entryToWrite, FILE *handleKmerTable, FILE *handleIDTable,
-                   uint16_t *kmerBuf, unsigned int *IDBuf) {
-    uint64_t kmerdiff = entryToWrite->kmerAsLong - lastKmer;
-    // Consecutively store 15 bits of information into a short, until kmer diff is all
-    uint16_t buffer[5]; // 15*5 = 75 > 64
-    buffer[4] = SET_END_FLAG(GET_15_BITS(kmerdiff));
-    kmerdiff >>= 15U;
-    int idx = 3;
-    while (kmerdiff) {
-        uint16_t toWrite = GET_15_BITS(kmerdiff);
-        kmerdiff >>= 15U;
-        buffer[idx] = toWrite;
-        idx--;
-    }
-    writeKmer(kmerBuf, handleKmerTable, (buffer + idx + 1), (4 - idx));
-    writeID(IDBuf, handleIDTable, entryToWrite->sequenceID);
-}
@@ -0,0 +1,208 @@
+#include "LocalParameters.h"
+#include "Debug.h"
+#include "FileUtil.h"
+#include "SRAUtil.h"
+#include "BitManipulateMacros.h"
+#include "TargetTableWriter.h"
+#include "TargetTableReader.h"
+#include "HotKmerPostings.h"
+#include "Timer.h"
+#include "QueryTableEntry.h"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <fstream>
+#include <iterator>
+
+#define MERGE_KMER_BUFSIZ (256 * 1024)
+#define MERGE_ID_BUFSIZ (128 * 1024)
+
+// Buffered sequential reader of a k-mer table, small buffers keep merging many tables cheap
+class MergeTableReader {
+public:
+    explicit MergeTableReader(const std::string &tableName)
+        : kmerBuf(MERGE_KMER_BUFSIZ), kmerPos(0), kmerEnd(0), idBytes(TargetTableReader::readIdBytes(tableName)),
+          idBuf(MERGE_ID_BUFSIZ * idBytes), idPos(0), idEnd(0), kmer(0), id(0) {
+        handleKmerTable = FileUtil::openFileOrDie(tableName.c_str(), "rb", true);
+        handleIDTable = FileUtil::openFileOrDie((tableName + "_ids").c_str(), "rb", true);
+    }
+
+    ~MergeTableReader() {
+        fclose(handleKmerTable);
+        fclose(handleIDTable);
+    }
+
+    bool next() {
+        uint64_t diff = 0;
+        while (true) {
+            if (kmerPos >= kmerEnd && fill(kmerBuf, handleKmerTable, kmerPos, kmerEnd) == false) {
+                return false;
+            }
+            const uint16_t chunk = kmerBuf[kmerPos++];
+            diff = DECODE_15_BITS(diff, chunk);
+            if (IS_LAST_15_BITS(chunk)) {
+                break;
+            }
+            diff <<= 15U;
+        }
+        kmer += diff;
+        if (idPos >= idEnd && fill(idBuf, handleIDTable, idPos, idEnd) == false) {
+            return false;
+        }
+        id = TargetTableReader::readId(idBuf.data() + idPos, idBytes);
+        idPos += idBytes;
+        return true;
+    }
+
+    unsigned long long getKmer() const {
+        return kmer;
+    }
+
+    uint64_t getId() const {
+        return id;
+    }
+
+private:
+    FILE *handleKmerTable;
+    FILE *handleIDTable;
+    std::vector<uint16_t> kmerBuf;
+    size_t kmerPos;
+    size_t kmerEnd;
+    unsigned int idBytes;
+    // the ID buffer holds a multiple of idBytes, so an ID never crosses a refill
+    std::vector<unsigned char> idBuf;
+    size_t idPos;
+    size_t idEnd;
+    unsigned long long kmer;
+    uint64_t id;
+
+    template <typename T>
+    static bool fill(std::vector<T> &buffer, FILE *handle, size_t &pos, size_t &end) {
+        pos = 0;
+        end = fread(buffer.data(), sizeof(T), buffer.size(), handle);
+        return end > 0;
+    }
+};
+
+// largest ID in the ID table of tableName, 0 for an empty table
+static uint64_t getMaxId(const std::string &tableName) {
+    const unsigned int idBytes = TargetTableReader::readIdBytes(tableName);
+    FILE *handle = FileUtil::openFileOrDie((tableName + "_ids").c_str(), "rb", true);
+    std::vector<unsigned char> buffer(MERGE_ID_BUFSIZ * idBytes);
+    uint64_t maxId = 0;
+    size_t count;
+    while ((count = fread(buffer.data(), sizeof(unsigned char), buffer.size(), handle)) > 0) {
+        for (size_t i = 0; i + idBytes <= count; i += idBytes) {
+            maxId = std::max(maxId, TargetTableReader::readId(buffer.data() + i, idBytes));
+        }
+    }
+    fclose(handle);
+    return maxId;
+}
+
+int mergekmertables(int argc, const char **argv, const Command &command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+    Timer timer;
+
+    std::vector<std::string> sourceTables = SRAUtil::getFileNamesFromFile(par.db1);
+    if (sourceTables.empty()) {
+        Debug(Debug::ERROR) << "Expected at least one table in the target table file\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    // all source tables have to share the k-mer parameters of the first one, the merged table inherits them
+    const std::string kmerParametersFile = sourceTables[0] + "_kmerparams";
+    std::string kmerParameters;
+    if (FileUtil::fileExists(kmerParametersFile.c_str())) {
+        std::ifstream in(kmerParametersFile);
+        kmerParameters.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        for (size_t j = 1; j < sourceTables.size(); ++j) {
+            SRAUtil::checkKmerParameters(sourceTables[j], kmerParameters);
+        }
+    }
+
+    // IDs of source table j are shifted by idOffsets[j] so that (table, ID) stays unique in the merged table
+    std::vector<uint64_t> idOffsets(sourceTables.size());
+    uint64_t nextOffset = 0;
+    for (size_t j = 0; j < sourceTables.size(); ++j) {
+        idOffsets[j] = nextOffset;
+        const uint64_t maxId = getMaxId(sourceTables[j]);
+        // hits are written to one result DB per source table, whose keys are 32-bit like the IDs of the source table itself
+        if (maxId > UINT_MAX) {
+            Debug(Debug::ERROR) << "IDs of source table " << sourceTables[j] << " do not fit into 32 bits\n";
+            EXIT(EXIT_FAILURE);
+        }
+        nextOffset += maxId + 1;
+        if (nextOffset > WideQueryTableEntry::NO_TARGET_ID) {
+            Debug(Debug::ERROR) << "Too many sequences to merge, stopped at table " << sourceTables[j] << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+    // IDs only take 5 bytes once they do not fit into 4 bytes anymore
+    const unsigned int idBytes = nextOffset - 1 > UINT_MAX ? 5 : 4;
+    Debug(Debug::INFO) << "ID offsets of " << sourceTables.size() << " tables computed, " << idBytes
+                       << " bytes per ID, time: " << timer.lap() << "\n";
+
+    std::vector<MergeTableReader *> readers(sourceTables.size());
+    // min-heap of (k-mer, table index), ties keep the table order
+    std::vector<std::pair<unsigned long long, size_t>> heap;
+    std::greater<std::pair<unsigned long long, size_t>> heapOrder;
+    for (size_t j = 0; j < sourceTables.size(); ++j) {
+        readers[j] = new MergeTableReader(sourceTables[j]);
+        if (readers[j]->next()) {
+            heap.emplace_back(readers[j]->getKmer(), j);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), heapOrder);
+
+    TargetTableWriter writer(par.db2, idBytes);
+    HotKmerPostings hotKmers;
+    size_t hotKmerIds = 0;
+    std::vector<uint64_t> groupIds;
+    while (heap.empty() == false) {
+        // collect the IDs of all source tables sharing the smallest k-mer
+        const unsigned long long kmer = heap.front().first;
+        groupIds.clear();
+        while (heap.empty() == false && heap.front().first == kmer) {
+            std::pop_heap(heap.begin(), heap.end(), heapOrder);
+            const size_t j = heap.back().second;
+            heap.pop_back();
+            MergeTableReader *reader = readers[j];
+            groupIds.emplace_back(idOffsets[j] + reader->getId());
+            if (reader->next()) {
+                heap.emplace_back(reader->getKmer(), j);
+                std::push_heap(heap.begin(), heap.end(), heapOrder);
+            }
+        }
+        if (par.hotKmerThreshold > 0 && groupIds.size() > par.hotKmerThreshold) {
+            std::sort(groupIds.begin(), groupIds.end());
+            hotKmers.add(kmer, groupIds);
+            hotKmerIds += groupIds.size();
+            continue;
+        }
+        for (size_t i = 0; i < groupIds.size(); ++i) {
+            writer.writeEntry(kmer, groupIds[i]);
+        }
+    }
+    writer.close();
+    TargetTableWriter::writeInfo(par.db2, sourceTables, idOffsets, idBytes);
+    if (kmerParameters.empty() == false) {
+        SRAUtil::writeKmerParameters(par.db2, kmerParameters);
+    }
+    if (par.hotKmerThreshold > 0) {
+        hotKmers.write(par.db2);
+        Debug(Debug::INFO) << "Hot k-mers: " << hotKmers.size() << " with " << hotKmerIds << " IDs in "
+                           << hotKmers.getDataSize() / 1024 << " KB\n";
+    } else if (FileUtil::fileExists((par.db2 + "_hot").c_str())) {
+        // a stale hot k-mer file would be joined as part of the new table
+        FileUtil::remove((par.db2 + "_hot").c_str());
+    }
+
+    for (size_t j = 0; j < readers.size(); ++j) {
+        delete readers[j];
+    }
+    Debug(Debug::INFO) << "Wrote " << writer.getEntryCount() << " k-mers, time: " << timer.lap() << "\n";
+    return EXIT_SUCCESS;
+}
@@ -59,6 +59,19 @@ std::vector<struct Command> commands = {
         {{"sequenceDB",  DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
             {"kmerTable",DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::flatfile}}
     },
+    {
+        "mergekmertables", mergekmertables, &localPar.mergekmertables, COMMAND_EXPERT,
+        "Merges several k-mer tables into one table",
+        "Merges the k-mer tables listed in the input file into one k-mer table. The IDs of each table are shifted by an offset "
+        "written to <mergedKmerTable>_info, comparekmertables splits the results back into one result DB per listed table. "
+        "The merged table stores 40-bit IDs if the shifted IDs do not fit into 32 bits. Each listed table is still limited "
+        "to 2^32 sequences, because its SRA DB, k-mer table and result DB use 32-bit keys.",
+        "",
+        "<i:kmerTableList> <o:mergedKmerTable>",
+        CITATION_MMSEQS2,
+        {{"kmerTableList", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::flatfile },
+            {"mergedKmerTable", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::flatfile}}
+    },
     {
         "comparekmertables", comparekmertables, &localPar.comparekmertables, COMMAND_EXPERT,
         "",
@@ -119,6 +132,33 @@ std::vector<struct Command> commands = {
         CITATION_MMSEQS2,
         {{"inputdb", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::flatfile }}
     },
+    {
+        "benchmarkkmergen", benchmarkkmergen, &localPar.benchmarkkmergen, COMMAND_HIDDEN,
+        "Measure the throughput of the similar k-mer generation",
+        NULL,
+        "",
+        "<i:queryDB>",
+        CITATION_MMSEQS2,
+        {{"queryDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}
+    },
+    {
+        "benchmarkkmerindex", benchmarkkmerindex, &localPar.benchmarkkmerindex, COMMAND_HIDDEN,
+        "Measure the k-mer index computation for a fixed k-mer size",
+        NULL,
+        "",
+        "<i:queryDB>",
+        CITATION_MMSEQS2,
+        {{"queryDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}
+    },
+    {
+        "benchmarkalignbackends", benchmarkalignbackends, &localPar.benchmarkalignbackends, COMMAND_HIDDEN,
+        "Measure the gapped alignment time of block-aligner and striped Smith-Waterman per sequence length",
+        NULL,
+        "",
+        "<i:queryDB>",
+        CITATION_MMSEQS2,
+        {{"queryDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}
+    },
     {
         "playground", playground, &localPar.onlyverbosity, COMMAND_HIDDEN,
         "",